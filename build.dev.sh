@@ -14,8 +14,8 @@
 "
 
 CC=gcc
-CFLAGS="-std=c89 -g -O3 -Wall -Wextra -Werror -pedantic -Wno-unused-variable -Wno-unused-parameter -Wno-declaration-after-statement -Wno-unused-but-set-variable"
-LDFLAGS="-I/usr/include/postgresql -lpq -largon2 -pthread"
+CFLAGS="-std=c89 -D_GNU_SOURCE -g -O3 -Wall -Wextra -Werror -pedantic -Wno-unused-variable -Wno-unused-parameter -Wno-declaration-after-statement -Wno-unused-but-set-variable"
+LDFLAGS="-I/usr/include/postgresql -lpq -largon2 -lz -pthread"
 
 SRC_DIR="src"
 
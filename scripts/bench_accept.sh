@@ -0,0 +1,72 @@
+#!/bin/bash
+
+: "
++-----------------------------------------------------------------------------------+
+|   This script measures how many new connections per second the server accepts     |
+|   and answers in each ACCEPT_MODE, pinning the server to 1, 2, ... n cores.       |
+|   Every request opens a new connection (no keep-alive), so the numbers reflect    |
+|   the accept path. Requires 'ab' (apache2-utils) and a built server binary.       |
++-----------------------------------------------------------------------------------+
+                                                                \   ^__^
+                                                                 \  (oo)\_______
+                                                                    (__)\       )\/\
+                                                                        ||----w |
+                                                                        ||     ||
+"
+
+if [ $# -gt 2 ]; then
+    echo "Usage: $0 [num_requests] [concurrency]"
+    exit 1
+fi
+
+NUM_REQUESTS="${1:-20000}"
+CONCURRENCY="${2:-256}"
+
+EXECUTABLE="build/bin/andlifecare"
+ENDPOINT="http://127.0.0.1:8080/src/web/static/globals.css"
+MAX_CORES=$(nproc)
+
+if ! command -v ab > /dev/null 2>&1; then
+    echo "'ab' not found, install apache2-utils"
+    exit 1
+fi
+
+if [ ! -x "$EXECUTABLE" ]; then
+    echo "$EXECUTABLE not found, run ./build.dev.sh first"
+    exit 1
+fi
+
+SETTINGS_FILE=$(mktemp)
+trap 'rm -f "$SETTINGS_FILE"' EXIT
+
+run_benchmark() {
+    local mode="$1"
+    local cores="$2"
+
+    printf "ACCEPT_MODE=%s\nWORKERS=%d\n" "$mode" "$cores" > "$SETTINGS_FILE"
+
+    taskset -c "0-$((cores - 1))" "$EXECUTABLE" "$SETTINGS_FILE" > /dev/null 2>&1 &
+    local server_pid=$!
+
+    # Wait for the server to start listening
+    for _ in $(seq 50); do
+        curl -s -o /dev/null "$ENDPOINT" && break
+        sleep 0.1
+    done
+
+    local requests_per_second
+    requests_per_second=$(ab -q -r -n "$NUM_REQUESTS" -c "$CONCURRENCY" "$ENDPOINT" 2> /dev/null | awk '/Requests per second/ { print $4 }')
+
+    kill -INT "$server_pid"
+    wait "$server_pid" 2> /dev/null
+
+    printf "%-10s %5d %15s\n" "$mode" "$cores" "${requests_per_second:-failed}"
+}
+
+printf "%-10s %5s %15s\n" "mode" "cores" "requests/sec"
+
+for mode in queue reuseport; do
+    for ((cores=1; cores<=MAX_CORES; cores++)); do
+        run_benchmark "$mode" "$cores"
+    done
+done
@@ -0,0 +1,222 @@
+/**
+ * Microbenchmark of request parsing, built and run by scripts/bench_parser.sh.
+ *
+ * Compares, on the headers a browser sends for a page load:
+ *      1. The previous parser: strchr/strstr to find delimiters, one malloc + memcpy per field, and
+ *         a strstr over the whole headers block for every header looked up.
+ *      2. web_utils_parse_http_request: views into the request, an indexed header table, and the
+ *         CRLF scanner picked for this CPU.
+ * And every implementation of find_crlfs on its own, indexing the line ends of the same request.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "utils/utils.h"
+#include "web/web.h"
+
+#define ROUNDS 20
+#define ITERATIONS_PER_ROUND 100000
+
+/** Split in lines, C89 compilers are not required to support string literals this long */
+const char *browser_request_lines[] = {"GET /ui-test?tab=users HTTP/1.1\r\n",
+                                       "Host: localhost:8080\r\n",
+                                       "Connection: keep-alive\r\n",
+                                       "Cache-Control: max-age=0\r\n",
+                                       "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n",
+                                       "sec-ch-ua-mobile: ?0\r\n",
+                                       "sec-ch-ua-platform: \"Linux\"\r\n",
+                                       "Upgrade-Insecure-Requests: 1\r\n",
+                                       "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n",
+                                       "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7\r\n",
+                                       "Sec-Fetch-Site: same-origin\r\n",
+                                       "Sec-Fetch-Mode: navigate\r\n",
+                                       "Sec-Fetch-User: ?1\r\n",
+                                       "Sec-Fetch-Dest: document\r\n",
+                                       "Referer: http://localhost:8080/sign-up\r\n",
+                                       "Accept-Encoding: gzip, deflate, br, zstd\r\n",
+                                       "Accept-Language: en-US,en;q=0.9,es;q=0.8\r\n",
+                                       "Cookie: session_id=2f1c8e4a-9b7d-4c3e-8f6a-1d2b3c4d5e6f; theme=dark; _ga=GA1.1.123456789.1700000000\r\n",
+                                       "If-None-Match: \"5d8c72a5edda8d6a:0\"\r\n",
+                                       "\r\n",
+                                       NULL};
+
+char browser_request[2048];
+size_t browser_request_length = 0;
+
+typedef struct {
+    char *method;
+    char *url;
+    char *query_params;
+    char *http_version;
+    char *headers;
+    char *body;
+} LegacyHttpRequest;
+
+char *legacy_copy(const char *start, size_t length) {
+    char *copy = (char *)malloc(length + 1);
+    memcpy(copy, start, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+/** Same steps as the parser web_utils_parse_http_request replaced, without its error handling */
+void legacy_parse_http_request(LegacyHttpRequest *request, const char *http_request) {
+    const char *method_end = strchr(http_request, ' ');
+    request->method = legacy_copy(http_request, method_end - http_request);
+
+    const char *url_start = method_end + 1;
+    const char *url_end = strchr(url_start, ' ');
+    const char *query_params_start = url_start;
+    while (*query_params_start != ' ' && *query_params_start != '?') {
+        query_params_start++;
+    }
+
+    request->query_params = NULL;
+    if (*query_params_start == '?') {
+        request->query_params = legacy_copy(query_params_start + 1, url_end - (query_params_start + 1));
+    }
+
+    request->url = legacy_copy(url_start, query_params_start - url_start);
+
+    const char *http_version_start = strchr(query_params_start, ' ') + 1;
+    const char *http_version_end = strstr(http_version_start, "\r\n");
+    request->http_version = legacy_copy(http_version_start, http_version_end - http_version_start);
+
+    const char *headers_start = http_version_end + 2;
+    const char *headers_end = strstr(headers_start, "\r\n\r\n");
+    request->headers = legacy_copy(headers_start, headers_end - headers_start);
+
+    const char *body_start = headers_end + 4;
+    size_t body_length = strlen(body_start);
+    request->body = body_length > 0 ? legacy_copy(body_start, body_length) : NULL;
+}
+
+void legacy_http_request_free(LegacyHttpRequest *request) {
+    free(request->method);
+    free(request->url);
+    free(request->query_params);
+    free(request->http_version);
+    free(request->headers);
+    free(request->body);
+}
+
+/** What a handler had to do to read a header out of the raw block */
+const char *legacy_find_header(const char *headers, const char *name) {
+    const char *found = strstr(headers, name);
+    return found != NULL ? found + strlen(name) : NULL;
+}
+
+double elapsed_nanoseconds(struct timespec *start, struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+/** Keeps the compiler from optimizing the measured work away */
+volatile size_t sink;
+
+const char *line_ends[HTTP_MAX_HEADERS + 1];
+
+void run_previous_parser(void) {
+    LegacyHttpRequest request;
+    legacy_parse_http_request(&request, browser_request);
+
+    sink += (size_t)legacy_find_header(request.headers, "Accept-Encoding: ");
+    sink += (size_t)legacy_find_header(request.headers, "If-None-Match: ");
+    sink += (size_t)legacy_find_header(request.headers, "If-Modified-Since: ");
+    sink += (size_t)legacy_find_header(request.headers, "HX-Request: ");
+    sink += (size_t)legacy_find_header(request.headers, "Cookie: ");
+
+    legacy_http_request_free(&request);
+}
+
+void run_header_table_parser(void) {
+    HttpRequest request;
+    if (web_utils_parse_http_request(&request, browser_request, browser_request_length) == -1) {
+        exit(1);
+    }
+
+    sink += (size_t)web_utils_known_header(&request, HTTP_HEADER_ACCEPT_ENCODING);
+    sink += (size_t)web_utils_known_header(&request, HTTP_HEADER_IF_NONE_MATCH);
+    sink += (size_t)web_utils_find_header(&request, "If-Modified-Since");
+    sink += (size_t)web_utils_known_header(&request, HTTP_HEADER_HX_REQUEST);
+    sink += (size_t)web_utils_known_header(&request, HTTP_HEADER_COOKIE);
+}
+
+void run_find_crlfs_scalar(void) {
+    sink += find_crlfs_scalar(browser_request, browser_request + browser_request_length, line_ends, HTTP_MAX_HEADERS + 1);
+}
+
+void run_find_crlfs_sse2(void) {
+    sink += find_crlfs_sse2(browser_request, browser_request + browser_request_length, line_ends, HTTP_MAX_HEADERS + 1);
+}
+
+void run_find_crlfs_avx2(void) {
+    sink += find_crlfs_avx2(browser_request, browser_request + browser_request_length, line_ends, HTTP_MAX_HEADERS + 1);
+}
+
+typedef struct {
+    const char *name;
+    void (*run)(void);
+    double best;
+} Benchmark;
+
+int main(void) {
+    long i;
+
+    for (i = 0; browser_request_lines[i] != NULL; i++) {
+        strcpy(browser_request + browser_request_length, browser_request_lines[i]);
+        browser_request_length += strlen(browser_request_lines[i]);
+    }
+
+    const char *scanner_name = select_crlf_scanner();
+
+    Benchmark benchmarks[5];
+    benchmarks[0].name = "previous parser + 5 lookups";
+    benchmarks[0].run = &run_previous_parser;
+    benchmarks[1].name = "header table parser + 5 lookups";
+    benchmarks[1].run = &run_header_table_parser;
+    benchmarks[2].name = "index line ends: scalar";
+    benchmarks[2].run = &run_find_crlfs_scalar;
+    benchmarks[3].name = "index line ends: sse2";
+    benchmarks[3].run = &run_find_crlfs_sse2;
+    benchmarks[4].name = "index line ends: avx2";
+    benchmarks[4].run = &run_find_crlfs_avx2;
+
+    int benchmarks_count = strcmp(scanner_name, "avx2") == 0 ? 5 : 4;
+
+    /**
+     * Rounds of every benchmark take turns and only the fastest round of each counts, so a noisy
+     * neighbour or a frequency change hits every benchmark alike instead of skewing one of them.
+     */
+    int round;
+    for (round = 0; round < ROUNDS; round++) {
+        int k;
+        for (k = 0; k < benchmarks_count; k++) {
+            struct timespec start, end;
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (i = 0; i < ITERATIONS_PER_ROUND; i++) {
+                benchmarks[k].run();
+            }
+            clock_gettime(CLOCK_MONOTONIC, &end);
+
+            double nanoseconds = elapsed_nanoseconds(&start, &end) / ITERATIONS_PER_ROUND;
+            if (round == 0 || nanoseconds < benchmarks[k].best) {
+                benchmarks[k].best = nanoseconds;
+            }
+        }
+    }
+
+    printf("Request: %lu bytes, %d header lines, scanner in use: %s\n\n", (unsigned long)browser_request_length, (int)(find_crlfs(browser_request, browser_request + browser_request_length, line_ends, HTTP_MAX_HEADERS + 1)) - 1, scanner_name);
+
+    int k;
+    for (k = 0; k < benchmarks_count; k++) {
+        printf("%-34s %8.1f ns/request\n", benchmarks[k].name, benchmarks[k].best);
+        if (k == 1) {
+            printf("%-34s %8.2fx\n\n", "speedup", benchmarks[0].best / benchmarks[1].best);
+        }
+    }
+
+    return 0;
+}
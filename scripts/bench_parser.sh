@@ -0,0 +1,27 @@
+#!/bin/bash
+
+: "
++-----------------------------------------------------------------------------------+
+|   This script builds and runs the request parser microbenchmark. It compares the  |
+|   previous parser against the current one on the headers a browser sends for a    |
+|   page load, and times every CRLF scanner the CPU supports on the same request.   |
++-----------------------------------------------------------------------------------+
+                                                                \   ^__^
+                                                                 \  (oo)\_______
+                                                                    (__)\       )\/\
+                                                                        ||----w |
+                                                                        ||     ||
+"
+
+CC=gcc
+CFLAGS="-std=c89 -D_GNU_SOURCE -O3 -Wall -Wextra -Werror -pedantic -Wno-unused-variable -Wno-unused-parameter -Wno-declaration-after-statement -Wno-unused-but-set-variable"
+SRC_DIR="src"
+EXECUTABLE="build/bin/bench_parser"
+
+mkdir -p "$(dirname "$EXECUTABLE")"
+
+# The parser only needs the connection table: web_utils_send_all and web_utils_send_file_range, in the same
+# file, hand responses to the client's connection (connection.c pulls in settings.c and timer_wheel.c)
+$CC $CFLAGS -I"$SRC_DIR" scripts/bench_parser.c "$SRC_DIR/web/web_utils.c" "$SRC_DIR/utils/scan.c" "$SRC_DIR/utils/utils.c" "$SRC_DIR/server/connection.c" "$SRC_DIR/server/settings.c" "$SRC_DIR/server/timer_wheel.c" -o "$EXECUTABLE" -pthread || exit 1
+
+"$EXECUTABLE"
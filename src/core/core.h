@@ -35,7 +35,7 @@ typedef struct {
     CountriesData countries_data;
 } UiTestResult;
 
-int core_ui_test(UiTestResult *result, int client_socket, int conn_index);
+int core_ui_test(UiTestResult *result, int client_socket);
 
 void core_utils_ui_test_free(UiTestResult *result);
 void core_utils_print_query_result(PGresult *query_result);
@@ -50,6 +50,11 @@ typedef struct {
     char session_id[37];
 } SignUpCreateUserResult;
 
-int core_sign_up_create_user(SignUpCreateUserResult *result, SignUpCreateUserInput *input, int client_socket, int conn_index);
+int core_sign_up_create_user(SignUpCreateUserResult *result, SignUpCreateUserInput *input, int client_socket);
+
+int core_db_pool_init(unsigned int size, const char *const *keywords, const char *const *values);
+void core_db_pool_free(void);
+PGconn *core_db_pool_acquire(void);
+void core_db_pool_release(PGconn *conn);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,91 @@
+#include <errno.h>
+#include <libpq-fe.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "core/core.h"
+
+/**
+ * Pool of database connections shared by every worker. Connections are not tied to a thread: a
+ * handler checks one out only around the queries it runs and gives it back right after, so the
+ * amount of workers and the amount of connections can be sized independently.
+ */
+PGconn **db_pool_connections = NULL;
+unsigned int db_pool_size = 0;
+unsigned int db_pool_idle_count = 0; /** db_pool_connections[0 .. idle_count) are free to check out */
+pthread_mutex_t db_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t db_pool_condition_var = PTHREAD_COND_INITIALIZER;
+
+int core_db_pool_init(unsigned int size, const char *const *keywords, const char *const *values) {
+    db_pool_connections = (PGconn **)calloc(size, sizeof(PGconn *));
+    if (db_pool_connections == NULL) {
+        fprintf(stderr, "Failed to allocate memory for db_pool_connections\nError code: %d\n", errno);
+        return -1;
+    }
+
+    db_pool_size = size;
+
+    unsigned int i;
+    for (i = 0; i < size; i++) {
+        db_pool_connections[i] = PQconnectdbParams(keywords, values, 0);
+        if (PQstatus(db_pool_connections[i]) != CONNECTION_OK) {
+            fprintf(stderr, "Failed to create db connection pool at iteration n° %d\nError code: %d\n", i, errno);
+            return -1;
+        }
+    }
+
+    db_pool_idle_count = size;
+
+    return 0;
+}
+
+/**
+ * Closes every connection. Must only be called once no thread can check out a connection anymore.
+ */
+void core_db_pool_free(void) {
+    unsigned int i;
+    for (i = 0; i < db_pool_size; i++) {
+        PQfinish(db_pool_connections[i]);
+        db_pool_connections[i] = NULL;
+    }
+
+    free(db_pool_connections);
+    db_pool_connections = NULL;
+    db_pool_size = 0;
+    db_pool_idle_count = 0;
+}
+
+/**
+ * Checks out a connection, waiting for one to be released if all of them are in use.
+ * Every connection checked out must be given back with core_db_pool_release.
+ */
+PGconn *core_db_pool_acquire(void) {
+    if (pthread_mutex_lock(&db_pool_mutex) != 0) {
+        fprintf(stderr, "Failed to lock db_pool_mutex\nError code: %d\n", errno);
+        return NULL;
+    }
+
+    while (db_pool_idle_count == 0) {
+        pthread_cond_wait(&db_pool_condition_var, &db_pool_mutex);
+    }
+
+    PGconn *conn = db_pool_connections[--db_pool_idle_count];
+
+    pthread_mutex_unlock(&db_pool_mutex);
+
+    return conn;
+}
+
+void core_db_pool_release(PGconn *conn) {
+    if (conn == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&db_pool_mutex);
+
+    db_pool_connections[db_pool_idle_count++] = conn;
+    pthread_cond_signal(&db_pool_condition_var);
+
+    pthread_mutex_unlock(&db_pool_mutex);
+}
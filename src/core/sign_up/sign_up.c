@@ -7,7 +7,6 @@
 #include <unistd.h>
 
 #include "core/core.h"
-#include "globals.h"
 #include "template_engine/template_engine.h"
 #include "utils/utils.h"
 
@@ -17,9 +16,7 @@
 
 int generate_salt(uint8_t *salt, size_t salt_size);
 
-int core_sign_up_create_user(SignUpCreateUserResult *result, SignUpCreateUserInput *input, int client_socket, int conn_index) {
-    PGconn *conn = conn_pool[conn_index];
-
+int core_sign_up_create_user(SignUpCreateUserResult *result, SignUpCreateUserInput *input, int client_socket) {
     /** Validate input data */
 
     /** Hash user password */
@@ -56,14 +53,24 @@ int core_sign_up_create_user(SignUpCreateUserResult *result, SignUpCreateUserInp
     const char *paramValues[1];
     paramValues[0] = input->email;
 
+    /** Only hold a db connection while querying, hashing the password above takes a while */
+    PGconn *conn = core_db_pool_acquire();
+    if (conn == NULL) {
+        return -1;
+    }
+
     /** Check whether user already exists */
     PGresult *found_user = PQexecParams(conn, "SELECT * FROM app.users WHERE email = $1", 1, NULL, paramValues, NULL, NULL, 0);
 
     if (PQresultStatus(found_user) != PGRES_TUPLES_OK) {
         fprintf(stderr, "%s\nError code: %d\n", PQerrorMessage(conn), errno);
+        PQclear(found_user);
+        core_db_pool_release(conn);
         return -1;
     }
 
+    core_db_pool_release(conn);
+
     core_utils_print_query_result(found_user);
 
     unsigned int rows = PQntuples(found_user);
@@ -6,23 +6,29 @@
 #include <unistd.h>
 
 #include "core/core.h"
-#include "globals.h"
 #include "utils/utils.h"
 
 int query_users(UiTestResult *result, PGconn *conn);
 int query_countries(UiTestResult *result, PGconn *conn);
 
-int core_ui_test(UiTestResult *result, int client_socket, int conn_index) {
-    PGconn *conn = conn_pool[conn_index];
+int core_ui_test(UiTestResult *result, int client_socket) {
+    PGconn *conn = core_db_pool_acquire();
+    if (conn == NULL) {
+        return -1;
+    }
 
     if (query_users(result, conn) == -1) {
+        core_db_pool_release(conn);
         return -1;
     }
 
     if (query_countries(result, conn) == -1) {
+        core_db_pool_release(conn);
         return -1;
     }
 
+    core_db_pool_release(conn);
+
     return 0;
 }
 
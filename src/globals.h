@@ -1,9 +1,9 @@
 #ifndef GLOBALS_H
 #define GLOBALS_H
 
-#include <libpq-fe.h>
+#include <signal.h>
 
-#define POOL_SIZE 3
-extern PGconn *conn_pool[POOL_SIZE];
+extern volatile sig_atomic_t keep_running;
+extern volatile sig_atomic_t draining;
 
 #endif
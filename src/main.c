@@ -1,6 +1,5 @@
 #include <arpa/inet.h>
 #include <errno.h>
-#include <libpq-fe.h>
 #include <linux/limits.h>
 #include <pthread.h>
 #include <signal.h>
@@ -10,25 +9,25 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "core/core.h"
 #include "globals.h"
+#include "server/server.h"
+#include "template_engine/template_engine.h"
 #include "utils/utils.h"
 #include "web/web.h"
 
-void sigint_handler(int signo);
-unsigned int has_file_extension(const char *file_path, const char *extension);
-int setup_server_socket(int *fd);
-int read_request(char **request_buffer, int client_socket);
-int router(void *p_client_socket, unsigned short conn_index);
+void shutdown_signal_handler(int signo);
+int setup_server_socket(int *fd, unsigned short reuseport);
+void dispatch_client_socket(int client_socket, unsigned short worker_index);
+void serve_client_socket(int client_socket, unsigned short worker_index);
+int serve_connection(int client_socket);
+int router(int client_socket, char *request, size_t request_length);
 void *thread_function(void *arg);
+void *reuseport_thread_function(void *arg);
+void *reload_thread_function(void *arg);
+void reload_configuration(const char *settings_file_path);
 void print_banner();
 int print_colored_message(const char *hex_color, const char *format, ...);
-void enqueue_client_socket(int *client_socket);
-void *dequeue_client_socket();
-
-typedef struct ClientSocketQueueNode {
-    struct ClientSocketQueueNode *next;
-    int *client_socket;
-} ClientSocketQueueNode;
 
 typedef struct {
     char DB_NAME[12];
@@ -41,32 +40,62 @@ typedef struct {
 #define PRINT_MESSAGE_COLOR "#0059ff"
 #define PRINT_MESSAGE_STATUS "#42ff62"
 
-#define MAX_CONNECTIONS 100
+#define MAX_CONNECTIONS 4096
 #define PORT 8080
 
 volatile sig_atomic_t keep_running = 1;
+volatile sig_atomic_t draining = 0;
+
+pthread_t *thread_pool = NULL;
+
+pthread_t reload_thread;
+
+ClientSocketQueue client_socket_queue;
 
-PGconn *conn_pool[POOL_SIZE];
-pthread_t thread_pool[POOL_SIZE];
-pthread_mutex_t thread_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t thread_condition_var = PTHREAD_COND_INITIALIZER;
+AdmissionControl admission;
 
-ClientSocketQueueNode *head_client_socket_queue = NULL;
-ClientSocketQueueNode *tail_client_socket_queue = NULL;
+ServerSettings settings;
 
-int main() {
+int main(int argc, char *argv[]) {
     int retval = 0;
 
     unsigned short i;
+    unsigned short threads_created = 0;
+    unsigned short reload_thread_created = 0;
+
+    int server_socket = -1;
+    EventLoop event_loop;
+    event_loop.epoll_fd = -1;
+    client_socket_queue.cells = NULL;
 
     print_banner();
 
     /**
-     * Registers a signal handler for SIGINT (to terminate the process) to exit the
-     * program gracefully for Valgrind to show the program report.
+     * Registers a signal handler for SIGINT and SIGTERM (to terminate the process) to exit the
+     * program gracefully: requests in flight are finished first, and Valgrind gets to show the
+     * program report.
      */
-    if (signal(SIGINT, sigint_handler) == SIG_ERR) {
-        fprintf(stderr, "Failed to set up signal handler for SIGINT\nError code: %d\n", errno);
+    if (signal(SIGINT, shutdown_signal_handler) == SIG_ERR || signal(SIGTERM, shutdown_signal_handler) == SIG_ERR) {
+        fprintf(stderr, "Failed to set up signal handler for SIGINT and SIGTERM\nError code: %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+
+    /** A client hanging up while we write to it must not kill the whole server */
+    if (signal(SIGPIPE, SIG_IGN) == SIG_ERR) {
+        fprintf(stderr, "Failed to ignore SIGPIPE\nError code: %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+
+    /**
+     * SIGHUP asks for a reload. It is blocked here, before any thread exists so every thread
+     * inherits the mask, and only ever taken by reload_thread_function with sigtimedwait: reloading
+     * can then allocate, read files and take locks, none of which a signal handler may do.
+     */
+    sigset_t reload_signals;
+    sigemptyset(&reload_signals);
+    sigaddset(&reload_signals, SIGHUP);
+    if (pthread_sigmask(SIG_BLOCK, &reload_signals, NULL) != 0) {
+        fprintf(stderr, "Failed to block SIGHUP\nError code: %d\n", errno);
         exit(EXIT_FAILURE);
     }
 
@@ -78,14 +107,23 @@ int main() {
         goto main_cleanup;
     }
 
-    int server_socket;
-    if (setup_server_socket(&server_socket) == -1) {
+    const char *settings_file_path = argc > 1 ? argv[1] : "server.conf";
+    if (server_settings_load(&settings, settings_file_path) == -1) {
+        fprintf(stderr, "Failed to load settings from file %s\nError code: %d\n", settings_file_path, errno);
         retval = -1;
         goto main_cleanup;
     }
 
-    print_colored_message(PRINT_MESSAGE_COLOR, "Server listening on port %d: ", PORT);
-    print_colored_message(PRINT_MESSAGE_STATUS, "Success!\n");
+    /** Connections take their limits and timeouts from the published snapshot, see server_settings_acquire */
+    if (server_settings_publish(&settings) == -1) {
+        retval = -1;
+        goto main_cleanup;
+    }
+
+    if (server_connections_init() == -1) {
+        retval = -1;
+        goto main_cleanup;
+    }
 
     const char *db_connection_keywords[] = {"dbname", "user", "password", "host", "port", NULL};
     const char *db_connection_values[6];
@@ -96,110 +134,147 @@ int main() {
     db_connection_values[4] = env.DB_PORT;
     db_connection_values[5] = NULL;
 
-    /** Create threads and db connection pool */
-    for (i = 0; i < POOL_SIZE; i++) {
-        /**
-         * Thread might take some time time to create, but 'i' will keep mutating as the program runs,
-         * storing the value of 'i' in the heap at the time of iterating ensures that thread_function
-         * receives the correct value even when 'i' has moved on.
-         */
-        unsigned short *p_iteration = malloc(sizeof(unsigned short));
-        *p_iteration = i;
-        if (pthread_create(&thread_pool[*p_iteration], NULL, &thread_function, p_iteration) != 0) {
-            fprintf(stderr, "Failed to create thread at iteration n° %d\nError code: %d\n", *p_iteration, errno);
-            retval = -1;
-            goto main_cleanup;
-        }
+    /** Create db connection pool before any thread can start handling requests */
+    if (core_db_pool_init(settings.db_connections, db_connection_keywords, db_connection_values) == -1) {
+        retval = -1;
+        goto main_cleanup;
     }
 
-    for (i = 0; i < POOL_SIZE; i++) {
-        conn_pool[i] = NULL;
+    print_colored_message(PRINT_MESSAGE_COLOR, "DB connection established: ");
+    print_colored_message(PRINT_MESSAGE_STATUS, "Success!\n");
+
+    /** The route table is only read once built, threads share it without locking */
+    if (web_router_init() == -1) {
+        retval = -1;
+        goto main_cleanup;
     }
 
-    for (i = 0; i < POOL_SIZE; i++) {
-        conn_pool[i] = PQconnectdbParams(db_connection_keywords, db_connection_values, 0);
-        if (PQstatus(conn_pool[i]) != CONNECTION_OK) {
-            fprintf(stderr, "Failed to create db connection pool at iteration n° %d\nError code: %d\n", i, errno);
-            retval = -1;
-            goto main_cleanup;
-        }
+    /** Assets and public pages are served from memory, they must be loaded before any thread starts */
+    if (web_static_cache_init() == -1) {
+        retval = -1;
+        goto main_cleanup;
     }
 
-    print_colored_message(PRINT_MESSAGE_COLOR, "DB connection established: ");
-    print_colored_message(PRINT_MESSAGE_STATUS, "Success!\n");
+    /** Same for the templates pages are rendered from */
+    if (te_template_cache_init() == -1) {
+        retval = -1;
+        goto main_cleanup;
+    }
 
-    while (1) {
-        struct sockaddr_in client_addr;
-        socklen_t client_addr_len = sizeof client_addr;
+    if (pthread_create(&reload_thread, NULL, &reload_thread_function, (void *)settings_file_path) != 0) {
+        fprintf(stderr, "Failed to create reload thread\nError code: %d\n", errno);
+        retval = -1;
+        goto main_cleanup;
+    }
 
-        /** The while loop will wait at accept for a new client to connect */
-        int client_socket;
-        client_socket = accept(server_socket, (struct sockaddr *)&client_addr, &client_addr_len);
-        /**
-         * When a signal to exit the program is received, accept will error with -1. To verify that
-         * client_socket being -1 isn't because of program termination, check whether the program
-         * has received a signal to exit.
-         */
-        if (keep_running == 0) {
-            /** Send signal to threads to resume execusion so they can proceed to cleanup */
-            pthread_cond_signal(&thread_condition_var);
-            retval = 0;
-            goto main_cleanup;
-        }
+    reload_thread_created = 1;
 
-        /** At this point, we know that client_socket being -1 wouldn't have been caused by program termination */
-        if (client_socket == -1) {
-            fprintf(stderr, "Failed to create client socket\nError code: %d\n", errno);
+    /** Parsing requests relies on the scanner picked here, it must happen before any thread starts */
+    print_colored_message(PRINT_MESSAGE_COLOR, "Request scanner: ");
+    print_colored_message(PRINT_MESSAGE_STATUS, "%s\n", select_crlf_scanner());
+
+    if (settings.accept_mode == ACCEPT_MODE_QUEUE) {
+        if (server_client_socket_queue_init(&client_socket_queue, settings.queue_capacity) == -1) {
             retval = -1;
             goto main_cleanup;
         }
 
         /**
-         * Store fd number for client socket in the heap so it can be pointed by a queue data structure
-         * and used when it is needed.
+         * Never below keeping every worker busy, never above what the queue holds. It starts with
+         * room for a request queued per worker and grows from there, unless it is disabled.
          */
-        int *p_client_socket = malloc(sizeof(int));
-        *p_client_socket = client_socket;
-
-        if (pthread_mutex_lock(&thread_mutex) != 0) {
-            fprintf(stderr, "Failed to lock pthread mutex\nError code: %d\n", errno);
+        size_t max_admitted = settings.queue_capacity + settings.workers;
+        if (server_admission_init(&admission, settings.workers, max_admitted, settings.admission_target_delay == 0 ? max_admitted : 2 * settings.workers) == -1) {
+            server_client_socket_queue_free(&client_socket_queue);
             retval = -1;
             goto main_cleanup;
         }
 
-        printf("- New request: enqueue_client_socket client socket fd %d\n", *p_client_socket);
-        enqueue_client_socket(p_client_socket);
+        if (setup_server_socket(&server_socket, 0) == -1) {
+            retval = -1;
+            goto main_cleanup;
+        }
 
-        if (pthread_cond_signal(&thread_condition_var) != 0) {
-            fprintf(stderr, "Failed to send pthread signal\nError code: %d\n", errno);
+        if (server_event_loop_init(&event_loop, server_socket, &dispatch_client_socket, 0, &admission, 0) == -1) {
             retval = -1;
             goto main_cleanup;
         }
 
-        if (pthread_mutex_unlock(&thread_mutex) != 0) {
-            fprintf(stderr, "Failed to unlock pthread mutex\nError code: %d\n", errno);
+        print_colored_message(PRINT_MESSAGE_COLOR, "Server listening on port %d: ", PORT);
+        print_colored_message(PRINT_MESSAGE_STATUS, "Success!\n");
+    }
+
+    thread_pool = (pthread_t *)malloc(settings.workers * sizeof(pthread_t));
+    if (thread_pool == NULL) {
+        fprintf(stderr, "Failed to allocate memory for thread_pool\nError code: %d\n", errno);
+        retval = -1;
+        goto main_cleanup;
+    }
+
+    /** Create threads */
+    for (i = 0; i < settings.workers; i++) {
+        /**
+         * Thread might take some time time to create, but 'i' will keep mutating as the program runs,
+         * storing the value of 'i' in the heap at the time of iterating ensures that thread_function
+         * receives the correct value even when 'i' has moved on.
+         */
+        unsigned short *p_iteration = malloc(sizeof(unsigned short));
+        *p_iteration = i;
+
+        void *(*start_routine)(void *) = settings.accept_mode == ACCEPT_MODE_REUSEPORT ? &reuseport_thread_function : &thread_function;
+        if (pthread_create(&thread_pool[*p_iteration], NULL, start_routine, p_iteration) != 0) {
+            fprintf(stderr, "Failed to create thread at iteration n° %d\nError code: %d\n", *p_iteration, errno);
+            free(p_iteration);
             retval = -1;
             goto main_cleanup;
         }
+
+        threads_created++;
     }
 
-main_cleanup:
+    if (settings.accept_mode == ACCEPT_MODE_REUSEPORT) {
+        /** Every worker runs its own event loop, the main thread only waits for the signal to exit */
+        while (keep_running && !draining) {
+            sleep(1);
+        }
 
-    for (i = 0; i < POOL_SIZE; i++) {
-        PQfinish(conn_pool[i]);
+        goto main_cleanup;
     }
 
-    close(server_socket);
+    /**
+     * The main thread becomes the event loop: it accepts clients and reads their requests without
+     * blocking, and only connections holding a complete request are queued for the thread pool.
+     */
+    if (server_event_loop_run(&event_loop) == -1) {
+        retval = -1;
+        goto main_cleanup;
+    }
 
-    for (i = 0; i < POOL_SIZE; i++) {
-        /**
-         * At this point, the variable 'keep_running' is 0.
-         * Signal all threads to resume execution to perform cleanup.
-         */
-        pthread_cond_signal(&thread_condition_var);
+main_cleanup:
+    /**
+     * The event loop is drained by now, or the program failed to start. Workers finish the
+     * connection they hold and exit. In reuseport mode the workers run the event loops themselves
+     * and stop once they are drained, they are only joined here.
+     */
+    if (settings.accept_mode != ACCEPT_MODE_REUSEPORT || !draining) {
+        keep_running = 0;
+    }
+
+    server_event_loop_free(&event_loop);
+
+    if (server_socket != -1) {
+        close(server_socket);
+    }
+
+    /**
+     * At this point, the variable 'keep_running' is 0. Wake up every thread waiting on the queue so
+     * they can proceed to cleanup.
+     */
+    if (client_socket_queue.cells != NULL) {
+        server_client_socket_queue_wake_all(&client_socket_queue, threads_created);
     }
 
-    for (i = 0; i < POOL_SIZE; i++) {
+    for (i = 0; i < threads_created; i++) {
         printf("(Thread %d) Cleaning up thread %lu\n", i, thread_pool[i]);
 
         if (pthread_join(thread_pool[i], NULL) != 0) {
@@ -207,6 +282,30 @@ main_cleanup:
         }
     }
 
+    free(thread_pool);
+    thread_pool = NULL;
+
+    /** Whatever is still running in the background (the static cache watcher, reloads) stops now */
+    keep_running = 0;
+
+    if (reload_thread_created && pthread_join(reload_thread, NULL) != 0) {
+        fprintf(stderr, "Failed to join reload thread\nError code: %d\n", errno);
+    }
+
+    /** Workers check connections out of the pool, it can only go away once they are all gone */
+    core_db_pool_free();
+
+    /** No thread is handling a connection anymore, the remaining ones can be closed */
+    server_connections_free();
+    if (client_socket_queue.cells != NULL) {
+        server_admission_free(&admission);
+    }
+    server_client_socket_queue_free(&client_socket_queue);
+    web_router_free();
+    web_static_cache_free();
+    te_template_cache_free();
+    server_settings_free();
+
     return retval;
 }
 
@@ -215,12 +314,12 @@ main_cleanup:
  * program, this same function is passed to all threads, resulting in each thread performing the same task:
  * handling client connections to this HTTP server.
  *
- * Inside the while loop, the function waits to receive a signal indicating a new client connection. Once
- * received, the connection is passed to the router for handling.
+ * Inside the while loop, the function waits for the event loop to queue a client connection holding a
+ * complete request. Once received, the connection is passed to the router for handling.
  *
  * @param       arg A pointer to an unsigned short value indicating the thread's position in the thread pool.
- *              It's used to assign a specific database connection from the connection pool to the thread.
- *              Each thread is associated with a unique connection from the pool.
+ *              It's only used to tell threads apart in the logs, database connections are checked out
+ *              from the shared pool by the handlers that need one.
  * @return      Always returns NULL
  */
 void *thread_function(void *arg) {
@@ -229,46 +328,30 @@ void *thread_function(void *arg) {
     printf("(Thread %d) Setting up thread %lu\n", *p_thread_index, tid);
 
     while (1) {
-        int *p_client_socket;
+        /** On hold until the event loop queues a client socket (or the program is exiting) */
+        int client_socket = server_client_socket_queue_pop(&client_socket_queue);
 
-        if (pthread_mutex_lock(&thread_mutex) != 0) {
-            /** TODO: cleanup */
-        }
-
-        /** Check queue for client request */
-        if ((p_client_socket = dequeue_client_socket()) == NULL) {
-            /** At this point, we know the queue was empty, so hold thread execusion */
-            pthread_cond_wait(&thread_condition_var, &thread_mutex); /** On hold, waiting to receive a signal... */
-            /** Signal to proceed with execusion has been sent */
-
-            if (keep_running == 0) {
-                pthread_mutex_unlock(&thread_mutex);
-                goto out;
+        if (keep_running == 0) {
+            if (client_socket != -1) {
+                server_admission_cancel(&admission);
+                server_connection_close(server_connection_get(client_socket));
             }
-
-            p_client_socket = dequeue_client_socket();
-            printf("(Thread %d) Dequeueing(received signal)...\n", *p_thread_index);
-            goto skip_print;
+            goto out;
         }
 
-        printf("(Thread %d) Dequeueing...\n", *p_thread_index);
+        if (client_socket == -1) {
+            continue;
+        }
 
-    skip_print:
+        /** Read before serving, the connection may be closed by the time the request is done */
+        Connection *conn = server_connection_get(client_socket);
+        unsigned long queued_for = server_admission_clock() - conn->admitted_at;
+        unsigned int target_delay = conn->settings->admission_target_delay;
 
-        if (pthread_mutex_unlock(&thread_mutex) != 0) {
-            /** TODO: cleanup */
-        }
+        /** A failed request (a client gone halfway through a streamed page, say) only costs its connection, which serve_connection closed */
+        serve_connection(client_socket);
 
-        if (p_client_socket != NULL) {
-            /*
-             * If router errors with -1, the thread exits silently.
-             * (Consider whether there is a better way to handle this scenario)
-             */
-            if (router(p_client_socket, *p_thread_index) == -1) {
-                printf("router returned error!\n");
-                break;
-            }
-        }
+        server_admission_release(&admission, queued_for, target_delay);
     }
 
 out:
@@ -280,194 +363,228 @@ out:
     return NULL;
 }
 
-int router(void *p_client_socket, unsigned short conn_index) {
-    int retval = 0;
+/**
+ * Start routine for the threads in ACCEPT_MODE_REUSEPORT. Every thread opens its own listening
+ * socket on PORT with SO_REUSEPORT and runs its own event loop on it. The kernel spreads incoming
+ * connections across the listening sockets, and each thread handles the requests of the clients it
+ * accepted itself, so no connection ever crosses between threads.
+ *
+ * @param       arg A pointer to an unsigned short value indicating the thread's position in the thread pool.
+ * @return      Always returns NULL
+ */
+void *reuseport_thread_function(void *arg) {
+    unsigned short thread_index = *((unsigned short *)arg);
 
-    /**
-     * At this point we don't need to hold the client_socket in heap anymore, we can work
-     * with it in the stack from now on
-     */
-    int client_socket = *((int *)p_client_socket);
+    free(arg);
+    arg = NULL;
 
-    free(p_client_socket);
-    p_client_socket = NULL;
+    printf("(Thread %d) Setting up thread %lu\n", thread_index, pthread_self());
 
-    char *request = NULL;
-    if (read_request(&request, client_socket) == -1) {
-        retval = -1;
-        goto cleanup_request_buffer;
+    int server_socket;
+    if (setup_server_socket(&server_socket, 1) == -1) {
+        keep_running = 0;
+        return NULL;
     }
 
-    if (strlen(request) == 0) {
-        fprintf(stderr, "Request is empty\nError code: %d\n", errno);
-        retval = 0;
-        goto cleanup_request_buffer;
+    /** At least one new request per batch of events is always served, at most a whole batch of them */
+    AdmissionControl batch_admission;
+    if (server_admission_init(&batch_admission, 1, EVENT_LOOP_MAX_EVENTS, EVENT_LOOP_MAX_EVENTS) == -1) {
+        close(server_socket);
+        keep_running = 0;
+        return NULL;
     }
 
-    HttpRequest parsed_http_request;
-    if (web_utils_parse_http_request(&parsed_http_request, request) == -1) {
-        retval = -1;
-        goto cleanup_request_buffer;
+    EventLoop event_loop;
+    if (server_event_loop_init(&event_loop, server_socket, &serve_client_socket, thread_index, &batch_admission, 1) == -1) {
+        server_admission_free(&batch_admission);
+        close(server_socket);
+        keep_running = 0;
+        return NULL;
     }
 
-    if (has_file_extension(parsed_http_request.url, ".css") == 0 && strcmp(parsed_http_request.method, "GET") == 0) {
-        /** TODO: improve http response headers */
-        char response_headers[] = "HTTP/1.1 200 OK\r\n"
-                                  "Content-Type: text/css\r\n"
-                                  "\r\n";
+    print_colored_message(PRINT_MESSAGE_COLOR, "(Thread %d) Server listening on port %d: ", thread_index, PORT);
+    print_colored_message(PRINT_MESSAGE_STATUS, "Success!\n");
 
-        if (web_static(client_socket, parsed_http_request.url, response_headers, strlen(response_headers)) == -1) {
-            retval = -1;
-            goto cleanup_parsed_request;
-        }
+    if (server_event_loop_run(&event_loop) == -1) {
+        keep_running = 0;
     }
 
-    if (has_file_extension(parsed_http_request.url, ".js") == 0 && strcmp(parsed_http_request.method, "GET") == 0) {
-        /** TODO: improve http response headers */
-        char response_headers[] = "HTTP/1.1 200 OK\r\n"
-                                  "Content-Type: application/javascript\r\n"
-                                  "\r\n";
+    printf("(Thread %d) Out of event loop\n", thread_index);
 
-        if (web_static(client_socket, parsed_http_request.url, response_headers, strlen(response_headers)) == -1) {
-            retval = -1;
-            goto cleanup_parsed_request;
-        }
-    }
+    server_event_loop_free(&event_loop);
+    server_admission_free(&batch_admission);
+    close(server_socket);
 
-    char *public_route = NULL;
-    if (requested_public_route(parsed_http_request.url) == 0) {
-        if (strcmp(parsed_http_request.method, "GET") == 0) {
-            if (construct_public_route_file_path(&public_route, parsed_http_request.url) == -1) {
-                retval = -1;
-                goto cleanup;
-            }
+    return NULL;
+}
 
-            /** TODO: improve http response headers */
-            char response_headers[] = "HTTP/1.1 200 OK\r\n"
-                                      "Content-Type: text/html\r\n"
-                                      "\r\n";
+/**
+ * Start routine of the thread that waits for SIGHUP, see reload_configuration. Wakes up every second
+ * to check whether the program is exiting.
+ *
+ * @param       arg The path of the settings file, as given to the program.
+ * @return      Always returns NULL
+ */
+void *reload_thread_function(void *arg) {
+    const char *settings_file_path = (const char *)arg;
 
-            if (web_static(client_socket, public_route, response_headers, strlen(response_headers)) == -1) {
-                retval = -1;
-                goto cleanup;
-            }
+    sigset_t reload_signals;
+    sigemptyset(&reload_signals);
+    sigaddset(&reload_signals, SIGHUP);
+
+    struct timespec timeout;
+    timeout.tv_sec = EVENT_LOOP_TIMEOUT_MS / 1000;
+    timeout.tv_nsec = 0;
+
+    while (keep_running) {
+        if (sigtimedwait(&reload_signals, NULL, &timeout) == SIGHUP) {
+            reload_configuration(settings_file_path);
         }
     }
 
-    if (strcmp(parsed_http_request.url, "/") == 0) {
-        if (strcmp(parsed_http_request.method, "GET") == 0) {
-            if (web_home_get(client_socket, &parsed_http_request) == -1) {
-                retval = -1;
-                goto cleanup;
-            }
-        }
-    } else if (strcmp(parsed_http_request.url, "/sign-up") == 0) {
-        if (strcmp(parsed_http_request.method, "GET") == 0) {
-            if (web_sign_up_get(client_socket, &parsed_http_request) == -1) {
-                retval = -1;
-                goto cleanup;
-            }
-        }
-    } else if (strcmp(parsed_http_request.url, "/sign-up/create-user") == 0) {
-        if (strcmp(parsed_http_request.method, "POST") == 0) {
-            if (web_sign_up_create_user_post(client_socket, &parsed_http_request, conn_index) == -1) {
-                retval = -1;
-                goto cleanup;
-            }
-        }
-    } else if (strcmp(parsed_http_request.url, "/ui-test") == 0) {
-        if (strcmp(parsed_http_request.method, "GET") == 0) {
-            if (web_ui_test_get(client_socket, &parsed_http_request, conn_index) == -1) {
-                retval = -1;
-                goto cleanup;
-            }
-        }
+    return NULL;
+}
+
+/**
+ * Reloads what can change without a restart: the settings file, the templates and the static
+ * files. Requests already in flight finish with what they started with, the next ones get the new
+ * versions. WORKERS, DB_CONNECTIONS, ACCEPT_MODE and QUEUE_CAPACITY size what was created at startup,
+ * changing them still needs a restart.
+ */
+void reload_configuration(const char *settings_file_path) {
+    print_colored_message(PRINT_MESSAGE_COLOR, "Received SIGHUP, reloading...\n");
+
+    ServerSettings reloaded_settings;
+    if (server_settings_load(&reloaded_settings, settings_file_path) == -1) {
+        fprintf(stderr, "Failed to reload settings from file %s, keeping the current ones\nError code: %d\n", settings_file_path, errno);
     } else {
-        if (web_not_found(client_socket, &parsed_http_request) == -1) {
-            retval = -1;
-            goto cleanup;
+        if (reloaded_settings.workers != settings.workers || reloaded_settings.db_connections != settings.db_connections || reloaded_settings.accept_mode != settings.accept_mode ||
+            reloaded_settings.queue_capacity != settings.queue_capacity) {
+            printf("WORKERS, DB_CONNECTIONS, ACCEPT_MODE and QUEUE_CAPACITY only change on restart\n");
         }
+
+        server_settings_publish(&reloaded_settings);
+    }
+
+    if (te_template_cache_reload() == -1) {
+        fprintf(stderr, "Failed to reload some templates, they keep their previous version\nError code: %d\n", errno);
     }
 
-cleanup:
-    free(public_route);
-    public_route = NULL;
+    web_static_cache_reload();
 
-cleanup_parsed_request:
-    web_utils_http_request_free(&parsed_http_request);
+    print_colored_message(PRINT_MESSAGE_COLOR, "Reload: ");
+    print_colored_message(PRINT_MESSAGE_STATUS, "Done!\n");
+}
 
-cleanup_request_buffer:
-    free(request);
-    request = NULL;
+/**
+ * Dispatch function of the event loops in ACCEPT_MODE_REUSEPORT, the request is handled right away
+ * on the event loop thread. How long it waited behind the requests handled before it in the same
+ * batch of events adjusts how many the loop lets in, see server_event_loop_shed.
+ */
+void serve_client_socket(int client_socket, unsigned short worker_index) {
+    /** Read before serving, the connection may be closed by the time the request is done */
+    Connection *conn = server_connection_get(client_socket);
+    AdmissionControl *batch_admission = conn->event_loop->admission;
+    unsigned long queued_for = server_admission_clock() - conn->event_loop->woke_at;
+    unsigned int target_delay = conn->settings->admission_target_delay;
 
-    return retval;
+    /** A failed request only costs its connection, which serve_connection closed */
+    serve_connection(client_socket);
+
+    server_admission_observe(batch_admission, queued_for, target_delay);
 }
 
-int read_request(char **request_buffer, int client_socket) {
-    size_t buffer_size = 1024;
+/**
+ * Handles every complete request buffered for a connection, in the order they were sent, so that
+ * pipelined requests get their responses in order. Afterwards the connection is either closed or,
+ * if it is kept alive, handed back to the event loop to wait for the next request.
+ *
+ * Responses are written without blocking. When the client doesn't read fast enough, the rest of
+ * the response is left to the event loop and the worker moves on right away: the event loop takes
+ * the connection from there once the response is out, see server_handle_writable_event. Streamed
+ * pages are the exception, their worker waits for each chunk to be read before queuing the next.
+ */
+int serve_connection(int client_socket) {
+    int retval = 0;
+    int next_request_status;
 
-    *request_buffer = (char *)malloc((buffer_size * (sizeof **request_buffer)) + 1);
-    if (*request_buffer == NULL) {
-        fprintf(stderr, "Failed to allocate memory for *request_buffer\nError code: %d\n", errno);
-        return -1;
-    }
+    /** The event loop already read a complete request into the connection buffer */
+    Connection *conn = server_connection_get(client_socket);
 
-    (*request_buffer)[0] = '\0';
+    do {
+        /** The server is shutting down, don't keep connections open for requests it won't serve */
+        if (draining) {
+            conn->keep_alive = 0;
+        }
+
+        /** Hide pipelined bytes from the router, the request ends where the next one begins */
+        char next_request_first_char = conn->buffer[conn->request_length];
+        conn->buffer[conn->request_length] = '\0';
 
-    size_t chunk_read = 0;
-    int bytes_read;
-    while ((bytes_read = recv(client_socket, (*request_buffer) + chunk_read, buffer_size - chunk_read, 0)) > 0) {
-        chunk_read += bytes_read;
+        retval = router(client_socket, conn->buffer, conn->request_length);
 
-        if (chunk_read >= buffer_size) {
-            buffer_size *= 2;
-            *request_buffer = realloc((*request_buffer), buffer_size);
-            if (*request_buffer == NULL) {
-                fprintf(stderr, "Failed to reallocate memory for *request_buffer\nError code: %d\n", errno);
-                free(*request_buffer);
-                *request_buffer = NULL;
-                return -1;
+        conn->buffer[conn->request_length] = next_request_first_char;
+
+        if (retval != -1 && conn->output_head != NULL) {
+            if (server_event_loop_watch(conn) == -1) {
+                server_connection_close(conn);
             }
-        } else {
-            break;
+
+            return 0;
         }
-    }
 
-    if (bytes_read == -1) {
-        fprintf(stderr, "Failed extract headers from *request_buffer\nError code: %d\n", errno);
-        free(*request_buffer);
-        *request_buffer = NULL;
-        return -1;
+        if (retval == -1 || !conn->keep_alive) {
+            server_connection_close(conn);
+            return retval;
+        }
+    } while ((next_request_status = server_connection_next_request(conn)) == 1);
+
+    if (next_request_status == -1 || conn->peer_closed) {
+        server_connection_close(conn);
+        return 0;
     }
 
-    (*request_buffer)[buffer_size] = '\0';
+    if (server_event_loop_watch(conn) == -1) {
+        server_connection_close(conn);
+    }
 
     return 0;
 }
 
-/**
- * @return 0 if the file path has the specified extension, 1 otherwise.
- */
-unsigned int has_file_extension(const char *file_path, const char *extension) {
-    size_t extension_length = strlen(extension) + 1;
-    size_t path_length = strlen(file_path) + 1;
-
-    if (extension_length > path_length) {
-        return 1;
+int router(int client_socket, char *request, size_t request_length) {
+    if (request_length == 0) {
+        fprintf(stderr, "Request is empty\nError code: %d\n", errno);
+        return 0;
     }
 
-    if (strncmp(file_path + path_length - extension_length, extension, extension_length) == 0) {
-        return 0;
+    HttpRequest parsed_http_request;
+    if (web_utils_parse_http_request(&parsed_http_request, request, request_length) == -1) {
+        /** The request was framed fine but can't be understood, there is no point keeping the connection */
+        server_connection_get(client_socket)->keep_alive = 0;
+
+        return web_response_send_status(client_socket, 400);
     }
 
-    return 1;
+    return web_router_dispatch(client_socket, &parsed_http_request);
 }
 
-void sigint_handler(int signo) {
-    if (signo == SIGINT) {
-        printf("\nReceived SIGINT, exiting program...\n");
-        keep_running = 0;
+/**
+ * The first signal starts draining: no new clients, requests in flight get up to SHUTDOWN_TIMEOUT
+ * seconds to finish. A second signal exits right away.
+ */
+void shutdown_signal_handler(int signo) {
+    if (signo != SIGINT && signo != SIGTERM) {
+        return;
     }
+
+    if (!draining) {
+        printf("\nReceived signal to exit, finishing requests in flight...\n");
+        draining = 1;
+        return;
+    }
+
+    printf("\nReceived signal to exit again, exiting program...\n");
+    keep_running = 0;
 }
 
 int print_colored_message(const char *hex_color, const char *format, ...) {
@@ -493,7 +610,11 @@ int print_colored_message(const char *hex_color, const char *format, ...) {
     return 0;
 }
 
-int setup_server_socket(int *fd) {
+/**
+ * @param       reuseport When set, the socket is opened with SO_REUSEPORT so several threads can each
+ *              listen on PORT with a socket of their own.
+ */
+int setup_server_socket(int *fd, unsigned short reuseport) {
     *fd = socket(AF_INET, SOCK_STREAM, 0);
 
     if (*fd == -1) {
@@ -508,6 +629,12 @@ int setup_server_socket(int *fd) {
         return -1;
     }
 
+    if (reuseport && setsockopt(*fd, SOL_SOCKET, SO_REUSEPORT, &optname, sizeof(int)) == -1) {
+        fprintf(stderr, "Failed to set port for reuse across listening sockets\nError code: %d\n", errno);
+        close(*fd);
+        return -1;
+    }
+
     struct sockaddr_in server_addr;
 
     /* IPv4 */
@@ -534,37 +661,30 @@ int setup_server_socket(int *fd) {
     return 0;
 }
 
-void enqueue_client_socket(int *client_socket) {
-    ClientSocketQueueNode *new_node = malloc(sizeof(ClientSocketQueueNode));
-    new_node->client_socket = client_socket;
-    new_node->next = NULL;
-
-    if (tail_client_socket_queue == NULL) {
-        head_client_socket_queue = new_node;
-    } else {
-        tail_client_socket_queue->next = new_node;
-    }
-
-    tail_client_socket_queue = new_node;
-}
+/**
+ * Dispatch function of the event loop in ACCEPT_MODE_QUEUE, called for every connection holding a
+ * complete request. Queues the client socket and wakes up one thread from the thread pool to handle it.
+ *
+ * When admission control is at its limit (or the queue is full), the request is answered right away
+ * with a 503 and the connection is closed: the client is better off retrying than waiting behind a
+ * backlog that can't be served in time, and the requests already admitted stay fast. Most shed
+ * requests never get here, the event loop turns them away before reading them. This catches the ones
+ * that started while there was room, when the limit was reached before they were complete.
+ */
+void dispatch_client_socket(int client_socket, unsigned short worker_index) {
+    Connection *conn = server_connection_get(client_socket);
 
-void *dequeue_client_socket() {
-    if (head_client_socket_queue == NULL) {
-        return NULL;
-    }
+    if (server_admission_acquire(&admission) == 0) {
+        conn->admitted_at = server_admission_clock();
 
-    int *result = head_client_socket_queue->client_socket;
-    ClientSocketQueueNode *temp = head_client_socket_queue;
-    head_client_socket_queue = head_client_socket_queue->next;
+        if (server_client_socket_queue_push(&client_socket_queue, client_socket) == 0) {
+            return;
+        }
 
-    if (head_client_socket_queue == NULL) {
-        tail_client_socket_queue = NULL;
+        server_admission_cancel(&admission);
     }
 
-    free(temp);
-    temp = NULL;
-
-    return result;
+    server_admission_shed(conn);
 }
 
 void print_banner() {
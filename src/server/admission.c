@@ -0,0 +1,163 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#include "server/server.h"
+
+/**
+ * Admission control for ACCEPT_MODE_QUEUE. Requests queued or being handled count against a limit,
+ * and the event loop answers the ones over it with 503 instead of queueing them. The limit follows
+ * an AIMD rule on the time requests wait in the queue for a worker:
+ *  - a whole limit's worth of requests served without waiting longer than ADMISSION_TARGET_DELAY
+ *    raises it by one,
+ *  - a request that waited longer cuts it by a tenth, at most once per ADMISSION_TARGET_DELAY since
+ *    the requests still queued were admitted under the previous limit.
+ *
+ * The queue wait is the signal rather than the time spent in handlers: a handler that is slow on
+ * its own (e.g. waiting on the database) doesn't mean the server is overloaded, a queue that keeps
+ * growing does. Under a spike the limit settles where requests admitted are served without
+ * lingering in the queue, and the rest are told to come back right away.
+ *
+ * A connection becoming readable while the limit is reached is shed before any of its request is
+ * read (see server_event_loop_shed), so an overloaded server spends nothing on the requests it
+ * turns away. The limit is only taken once a request is complete and about to be queued.
+ *
+ * Only the event loop thread acquires, workers release.
+ *
+ * In ACCEPT_MODE_REUSEPORT every event loop handles its requests itself and has a limit of its own,
+ * on the new requests a single batch of events may admit (see server_event_loop_shed). The same rule
+ * adjusts it from how long each request waited behind the ones before it in its batch, through
+ * server_admission_observe.
+ */
+
+/** Sent as is to requests shed by admission control, nothing about them is looked at */
+static const char service_unavailable_response[] = "HTTP/1.1 503 Service Unavailable\r\n"
+                                                   "Content-Length: 0\r\n"
+                                                   "Connection: close\r\n"
+                                                   "Retry-After: 1\r\n"
+                                                   "\r\n";
+
+/**
+ * @param       min_limit The limit never goes lower, typically the number of workers.
+ * @param       max_limit The limit never goes higher, typically what the queue holds plus the workers.
+ * @param       initial_limit Where the limit starts from, it is only raised as requests are served.
+ */
+int server_admission_init(AdmissionControl *admission, size_t min_limit, size_t max_limit, size_t initial_limit) {
+    admission->in_flight = 0;
+    admission->min_limit = min_limit;
+    admission->max_limit = max_limit;
+    admission->limit = initial_limit < min_limit ? min_limit : initial_limit > max_limit ? max_limit : initial_limit;
+    admission->window_admitted = 0;
+    admission->last_decrease = 0;
+
+    if (pthread_mutex_init(&admission->mutex, NULL) != 0) {
+        fprintf(stderr, "Failed to initialize admission mutex\nError code: %d\n", errno);
+        return -1;
+    }
+
+    return 0;
+}
+
+void server_admission_free(AdmissionControl *admission) {
+    pthread_mutex_destroy(&admission->mutex);
+}
+
+/**
+ * @return      0 if the request is admitted, -1 if it must be shed.
+ */
+int server_admission_acquire(AdmissionControl *admission) {
+    if (__sync_add_and_fetch(&admission->in_flight, 1) > admission->limit) {
+        __sync_sub_and_fetch(&admission->in_flight, 1);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @return      1 if a request arriving now would be shed, without taking anything from the limit.
+ */
+int server_admission_full(AdmissionControl *admission) {
+    return admission->in_flight >= admission->limit;
+}
+
+/**
+ * Answers a shed request with 503 and Retry-After and closes its connection, whatever part of the
+ * request was read so far.
+ */
+void server_admission_shed(Connection *conn) {
+    /** Best effort, the socket is non-blocking and is closed right after either way */
+    send(conn->fd, service_unavailable_response, sizeof service_unavailable_response - 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+    server_connection_close(conn);
+}
+
+/**
+ * Gives back what server_admission_acquire took for a request that never reached a worker, without
+ * it counting towards the limit either way.
+ */
+void server_admission_cancel(AdmissionControl *admission) {
+    __sync_sub_and_fetch(&admission->in_flight, 1);
+}
+
+/**
+ * Called once a worker is done with a request it was handed.
+ *
+ * @param       queued_for Milliseconds the request waited in the queue before a worker took it.
+ * @param       target_delay ADMISSION_TARGET_DELAY, 0 keeps the limit at its maximum.
+ */
+void server_admission_release(AdmissionControl *admission, unsigned long queued_for, unsigned int target_delay) {
+    __sync_sub_and_fetch(&admission->in_flight, 1);
+
+    server_admission_observe(admission, queued_for, target_delay);
+}
+
+/**
+ * Adjusts the limit from how long a request waited before it was handled, see the AIMD rule above.
+ *
+ * @param       queued_for Milliseconds the request waited.
+ * @param       target_delay ADMISSION_TARGET_DELAY, 0 keeps the limit at its maximum.
+ */
+void server_admission_observe(AdmissionControl *admission, unsigned long queued_for, unsigned int target_delay) {
+    if (target_delay == 0) {
+        admission->limit = admission->max_limit;
+        return;
+    }
+
+    pthread_mutex_lock(&admission->mutex);
+
+    size_t limit = admission->limit;
+
+    if (queued_for > target_delay) {
+        unsigned long now = server_admission_clock();
+
+        if (now - admission->last_decrease >= target_delay) {
+            size_t decrease = limit / 10 > 0 ? limit / 10 : 1;
+            limit = limit - decrease > admission->min_limit ? limit - decrease : admission->min_limit;
+
+            admission->last_decrease = now;
+            admission->window_admitted = 0;
+        }
+    } else if (++admission->window_admitted >= limit) {
+        if (limit < admission->max_limit) {
+            limit++;
+        }
+
+        admission->window_admitted = 0;
+    }
+
+    admission->limit = limit;
+
+    pthread_mutex_unlock(&admission->mutex);
+}
+
+/**
+ * @return      Monotonic milliseconds.
+ */
+unsigned long server_admission_clock(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
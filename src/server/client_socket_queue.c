@@ -0,0 +1,158 @@
+#include <errno.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "server/server.h"
+
+/**
+ * Bounded multi-producer/multi-consumer queue of client sockets, after Dmitry Vyukov's array based
+ * queue. Every cell carries a sequence number telling whether it is ready to be written (sequence
+ * equals the position) or read (sequence equals the position + 1). Producers and consumers claim a
+ * position with a compare-and-swap on their own counter and never take a lock.
+ *
+ * The counters sit on separate cache lines so producers and consumers don't keep stealing the
+ * same line from each other. A semaphore counts published sockets, which lets idle workers sleep
+ * in the kernel (glibc semaphores are futex based) instead of spinning, and lets a producer wake
+ * exactly as many workers as there are sockets.
+ */
+
+/**
+ * @param       capacity Number of cells, must be a power of two.
+ */
+int server_client_socket_queue_init(ClientSocketQueue *queue, size_t capacity) {
+    if (capacity < 2 || (capacity & (capacity - 1)) != 0) {
+        fprintf(stderr, "Client socket queue capacity must be a power of two, got %lu\nError code: %d\n", (unsigned long)capacity, errno);
+        return -1;
+    }
+
+    queue->cells = (ClientSocketQueueCell *)malloc(capacity * sizeof(ClientSocketQueueCell));
+    if (queue->cells == NULL) {
+        fprintf(stderr, "Failed to allocate memory for queue->cells\nError code: %d\n", errno);
+        return -1;
+    }
+
+    size_t i;
+    for (i = 0; i < capacity; i++) {
+        queue->cells[i].sequence = i;
+        queue->cells[i].client_socket = -1;
+    }
+
+    queue->mask = capacity - 1;
+    queue->enqueue_position = 0;
+    queue->dequeue_position = 0;
+
+    if (sem_init(&queue->available, 0, 0) == -1) {
+        fprintf(stderr, "Failed to initialize queue->available semaphore\nError code: %d\n", errno);
+        free(queue->cells);
+        queue->cells = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+void server_client_socket_queue_free(ClientSocketQueue *queue) {
+    if (queue->cells == NULL) {
+        return;
+    }
+
+    sem_destroy(&queue->available);
+
+    free(queue->cells);
+    queue->cells = NULL;
+}
+
+/**
+ * Adds a client socket to the queue and wakes up one waiting consumer. Never blocks.
+ *
+ * @return      0 on success, -1 if the queue is full.
+ */
+int server_client_socket_queue_push(ClientSocketQueue *queue, int client_socket) {
+    size_t position = __atomic_load_n(&queue->enqueue_position, __ATOMIC_RELAXED);
+
+    while (1) {
+        ClientSocketQueueCell *cell = &queue->cells[position & queue->mask];
+        size_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        long difference = (long)sequence - (long)position;
+
+        if (difference == 0) {
+            /** The cell is free for this position, try to claim it */
+            if (__atomic_compare_exchange_n(&queue->enqueue_position, &position, position + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                cell->client_socket = client_socket;
+                __atomic_store_n(&cell->sequence, position + 1, __ATOMIC_RELEASE);
+                break;
+            }
+            /** Another producer claimed it first, position was reloaded by the failed exchange */
+        } else if (difference < 0) {
+            /** The consumers have not freed this cell yet: the queue is full */
+            return -1;
+        } else {
+            position = __atomic_load_n(&queue->enqueue_position, __ATOMIC_RELAXED);
+        }
+    }
+
+    sem_post(&queue->available);
+
+    return 0;
+}
+
+/**
+ * Takes the oldest client socket from the queue, sleeping while the queue is empty.
+ *
+ * @return      The client socket, or -1 when the consumer was woken up without a socket to handle
+ *              (see server_client_socket_queue_wake_all).
+ */
+int server_client_socket_queue_pop(ClientSocketQueue *queue) {
+    while (sem_wait(&queue->available) == -1) {
+        if (errno != EINTR) {
+            fprintf(stderr, "Failed to wait on queue->available semaphore\nError code: %d\n", errno);
+            return -1;
+        }
+    }
+
+    size_t position = __atomic_load_n(&queue->dequeue_position, __ATOMIC_RELAXED);
+
+    while (1) {
+        ClientSocketQueueCell *cell = &queue->cells[position & queue->mask];
+        size_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        long difference = (long)sequence - (long)(position + 1);
+
+        if (difference == 0) {
+            if (__atomic_compare_exchange_n(&queue->dequeue_position, &position, position + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                int client_socket = cell->client_socket;
+                /** Hand the cell back to producers, one lap ahead */
+                __atomic_store_n(&cell->sequence, position + queue->mask + 1, __ATOMIC_RELEASE);
+                return client_socket;
+            }
+        } else if (difference < 0) {
+            /**
+             * Nothing published at this position. Either this is a wake up without a socket, or a
+             * producer that claimed an earlier cell has not finished writing it yet while a later
+             * one already posted. No producer claiming this position means nothing was enqueued
+             * for it, so it is a wake up. Otherwise its socket is on the way, retry once the
+             * producer had a chance to finish.
+             */
+            if (__atomic_load_n(&queue->enqueue_position, __ATOMIC_RELAXED) == position) {
+                return -1;
+            }
+
+            sched_yield();
+            position = __atomic_load_n(&queue->dequeue_position, __ATOMIC_RELAXED);
+        } else {
+            position = __atomic_load_n(&queue->dequeue_position, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/**
+ * Wakes up to consumers_count consumers blocked in server_client_socket_queue_pop. Consumers that
+ * find the queue empty return -1 so they can check whether the program is exiting.
+ */
+void server_client_socket_queue_wake_all(ClientSocketQueue *queue, unsigned int consumers_count) {
+    unsigned int i;
+    for (i = 0; i < consumers_count; i++) {
+        sem_post(&queue->available);
+    }
+}
@@ -0,0 +1,852 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/sockios.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "server/server.h"
+#include "utils/utils.h"
+
+/** Milliseconds between two checks of a client a worker waits on, see server_connection_drain */
+#define CONNECTION_DRAIN_POLL_INTERVAL 1000
+
+/** Bytes per second a client must read a streamed page at, see server_connection_drain */
+#define CONNECTION_DRAIN_MIN_RATE 1024
+
+Connection *connections = NULL;
+size_t connections_capacity = 0;
+volatile size_t connections_high_water = 0; /** One past the highest fd ever opened, bounds table scans */
+
+void server_connection_set_keep_alive(Connection *conn, size_t headers_length);
+int server_connection_reject(Connection *conn, const char *status_line);
+int server_connection_header_names_valid(const char *headers, size_t headers_length);
+void server_connection_queue_output(Connection *conn, OutputChunk *chunk);
+void server_connection_free_output(OutputChunk *chunk);
+
+/**
+ * Allocates the connection table. It holds one slot per fd the process is allowed to open, so
+ * looking up a connection by its client_socket never needs a lock or a hash.
+ */
+int server_connections_init(void) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == -1) {
+        fprintf(stderr, "Failed to get the open files limit\nError code: %d\n", errno);
+        return -1;
+    }
+
+    connections_capacity = (size_t)limit.rlim_cur;
+
+    connections = (Connection *)calloc(connections_capacity, sizeof(Connection));
+    if (connections == NULL) {
+        fprintf(stderr, "Failed to allocate memory for connections\nError code: %d\n", errno);
+        return -1;
+    }
+
+    size_t i;
+    for (i = 0; i < connections_capacity; i++) {
+        connections[i].fd = -1;
+        connections[i].timer_slot = -1;
+    }
+
+    return 0;
+}
+
+void server_connections_free(void) {
+    size_t i;
+    for (i = 0; i < connections_capacity; i++) {
+        if (connections[i].fd != -1) {
+            server_connection_close(&connections[i]);
+        }
+    }
+
+    free(connections);
+    connections = NULL;
+    connections_capacity = 0;
+}
+
+Connection *server_connection_get(int client_socket) {
+    if (client_socket < 0 || (size_t)client_socket >= connections_capacity) {
+        return NULL;
+    }
+
+    return &connections[client_socket];
+}
+
+int server_connection_open(int client_socket, EventLoop *event_loop) {
+    Connection *conn = server_connection_get(client_socket);
+    if (conn == NULL) {
+        fprintf(stderr, "Client socket fd %d does not fit in the connection table\nError code: %d\n", client_socket, errno);
+        return -1;
+    }
+
+    conn->buffer = (char *)malloc(CONNECTION_INITIAL_BUFFER_SIZE * (sizeof *conn->buffer) + 1);
+    if (conn->buffer == NULL) {
+        fprintf(stderr, "Failed to allocate memory for conn->buffer\nError code: %d\n", errno);
+        return -1;
+    }
+
+    conn->settings = server_settings_acquire();
+
+    conn->buffer[0] = '\0';
+    conn->buffer_length = 0;
+    conn->buffer_capacity = CONNECTION_INITIAL_BUFFER_SIZE;
+    conn->request_length = 0;
+    conn->headers_scanned = 0;
+    conn->expected_length = 0;
+    conn->peer_closed = 0;
+    conn->keep_alive = 0;
+    conn->state = CONNECTION_STATE_READING;
+    conn->last_active = server_connection_clock();
+    conn->request_started = 0;
+    conn->body_started = 0;
+    conn->event_loop = event_loop;
+    conn->output_head = NULL;
+    conn->output_tail = NULL;
+    conn->fd = client_socket;
+
+    /** Several event loops may open connections at once, only ever move the mark up */
+    size_t high_water;
+    while ((size_t)client_socket >= (high_water = connections_high_water)) {
+        if (__sync_bool_compare_and_swap(&connections_high_water, high_water, (size_t)client_socket + 1)) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Releases the connection state before closing the socket. The order matters: as soon as the fd
+ * is closed the kernel may hand the same number to a new client, which reuses this table slot.
+ */
+void server_connection_close(Connection *conn) {
+    int client_socket = conn->fd;
+
+    if (conn->timer_slot != -1) {
+        server_timer_cancel(&conn->event_loop->timers, conn);
+    }
+
+    free(conn->buffer);
+    conn->buffer = NULL;
+    conn->buffer_length = 0;
+    conn->buffer_capacity = 0;
+    conn->request_length = 0;
+    conn->headers_scanned = 0;
+    conn->expected_length = 0;
+    conn->peer_closed = 0;
+    conn->keep_alive = 0;
+    conn->state = CONNECTION_STATE_READING;
+    conn->event_loop = NULL;
+
+    server_settings_release(conn->settings);
+    conn->settings = NULL;
+
+    while (conn->output_head != NULL) {
+        OutputChunk *next = conn->output_head->next;
+        server_connection_free_output(conn->output_head);
+        conn->output_head = next;
+    }
+
+    conn->output_tail = NULL;
+    conn->fd = -1;
+
+    close(client_socket);
+}
+
+/**
+ * Reads from the (non-blocking) socket into the connection buffer until it holds a complete request
+ * or the kernel has nothing more to give. Meant to be called by the event loop every time the socket
+ * is reported readable.
+ *
+ * While the headers are incomplete the buffer grows by doubling, but never past the header limit.
+ * Once the headers are in, the buffer is resized once to the exact length of the request, so a large
+ * body is read straight into place. Reading stops as soon as the request is complete: whatever the
+ * client pipelined after it stays in the kernel until the connection is watched again.
+ *
+ * @return      1 when the buffer holds a complete request, 0 when more bytes are needed and -1 when
+ *              the connection should be closed (error, request rejected, or the peer left without a
+ *              complete request).
+ */
+int server_connection_read(Connection *conn) {
+    int frame_status = server_connection_frame_request(conn);
+
+    while (frame_status == 0) {
+        if (conn->buffer_length == conn->buffer_capacity) {
+            /** Only reachable while the headers are incomplete, see server_connection_frame_request */
+            size_t new_capacity = conn->buffer_capacity * 2;
+            if (new_capacity > conn->settings->max_header_size) {
+                new_capacity = conn->settings->max_header_size;
+            }
+
+            char *new_buffer = (char *)realloc(conn->buffer, new_capacity * (sizeof *conn->buffer) + 1);
+            if (new_buffer == NULL) {
+                fprintf(stderr, "Failed to reallocate memory for conn->buffer\nError code: %d\n", errno);
+                return -1;
+            }
+
+            conn->buffer = new_buffer;
+            conn->buffer_capacity = new_capacity;
+        }
+
+        ssize_t bytes_read = recv(conn->fd, conn->buffer + conn->buffer_length, conn->buffer_capacity - conn->buffer_length, 0);
+
+        if (bytes_read > 0) {
+            conn->last_active = server_connection_clock();
+            if (conn->buffer_length == 0) {
+                conn->request_started = conn->last_active;
+            }
+
+            conn->buffer_length += bytes_read;
+            conn->buffer[conn->buffer_length] = '\0';
+
+            frame_status = server_connection_frame_request(conn);
+            continue;
+        }
+
+        if (bytes_read == 0) {
+            conn->peer_closed = 1;
+            return -1;
+        }
+
+        if (errno == EINTR) {
+            continue;
+        }
+
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        }
+
+        fprintf(stderr, "Failed to read from client socket fd %d\nError code: %d\n", conn->fd, errno);
+        return -1;
+    }
+
+    return frame_status;
+}
+
+/**
+ * Looks for a complete request at the front of the connection buffer. A request is complete once
+ * its headers are terminated and as many body bytes as its Content-Length announces have arrived.
+ * Requests with a Transfer-Encoding, with conflicting Content-Length headers or with a header line
+ * that has no valid name are rejected, so a body can never be mistaken for the next request.
+ * Bytes past the request belong to the next (pipelined) request and are left untouched.
+ *
+ * The search is incremental: bytes already scanned for the end of the headers are not scanned
+ * again, and the headers are only parsed once. Requests over the header or body limits are
+ * answered with 431 or 413 as soon as that is known, without waiting for the rest of them.
+ *
+ * @return      1 if a complete request was found (conn->request_length is set), 0 if more bytes
+ *              are needed, -1 if the request was rejected and the connection must be closed.
+ */
+int server_connection_frame_request(Connection *conn) {
+    conn->request_length = 0;
+
+    if (conn->expected_length == 0) {
+        /** The terminator may straddle what was already scanned and what just arrived */
+        size_t scan_from = conn->headers_scanned > 3 ? conn->headers_scanned - 3 : 0;
+
+        char *headers_end = (char *)memmem(conn->buffer + scan_from, conn->buffer_length - scan_from, "\r\n\r\n", 4);
+        if (headers_end == NULL) {
+            conn->headers_scanned = conn->buffer_length;
+
+            if (conn->buffer_length >= conn->settings->max_header_size) {
+                return server_connection_reject(conn, "431 Request Header Fields Too Large");
+            }
+
+            return 0;
+        }
+
+        size_t headers_length = headers_end - conn->buffer;
+        if (headers_length + 4 > conn->settings->max_header_size) { /* 4 -> "\r\n\r\n" */
+            return server_connection_reject(conn, "431 Request Header Fields Too Large");
+        }
+
+        /** "Transfer-Encoding : chunked" would slip past the checks below, and a proxy may still honour it */
+        if (!server_connection_header_names_valid(conn->buffer, headers_length)) {
+            return server_connection_reject(conn, "400 Bad Request");
+        }
+
+        size_t value_length;
+
+        /**
+         * Chunked bodies are not supported. Framing such a request by its Content-Length (or
+         * without a body) would read the chunks as the next pipelined request, so it is refused.
+         */
+        if (server_connection_find_header(conn->buffer, headers_length, "Transfer-Encoding", &value_length) != NULL) {
+            return server_connection_reject(conn, "501 Not Implemented");
+        }
+
+        size_t body_length = 0;
+        unsigned short content_length_found = 0;
+
+        /** Every Content-Length header is checked, several of them must all announce the same length */
+        const char *search_from = conn->buffer;
+        const char *content_length;
+        while ((content_length = server_connection_find_header(search_from, headers_length - (search_from - conn->buffer), "Content-Length", &value_length)) != NULL) {
+            if (value_length == 0) {
+                return server_connection_reject(conn, "400 Bad Request");
+            }
+
+            size_t length = 0;
+
+            size_t i;
+            for (i = 0; i < value_length; i++) {
+                if (content_length[i] < '0' || content_length[i] > '9') {
+                    return server_connection_reject(conn, "400 Bad Request");
+                }
+
+                /** Checked digit by digit so a huge value can neither overflow nor slip under the limit */
+                length = length * 10 + (content_length[i] - '0');
+                if (length > conn->settings->max_body_size) {
+                    return server_connection_reject(conn, "413 Content Too Large");
+                }
+            }
+
+            if (content_length_found && length != body_length) {
+                return server_connection_reject(conn, "400 Bad Request");
+            }
+
+            body_length = length;
+            content_length_found = 1;
+
+            /** The search skips its first line, which is the rest of this header */
+            search_from = content_length;
+        }
+
+        server_connection_set_keep_alive(conn, headers_length);
+
+        conn->expected_length = headers_length + 4 + body_length;
+        conn->body_started = server_connection_clock();
+
+        if (conn->expected_length > conn->buffer_capacity) {
+            char *new_buffer = (char *)realloc(conn->buffer, conn->expected_length * (sizeof *conn->buffer) + 1);
+            if (new_buffer == NULL) {
+                fprintf(stderr, "Failed to reallocate memory for conn->buffer\nError code: %d\n", errno);
+                return -1;
+            }
+
+            conn->buffer = new_buffer;
+            conn->buffer_capacity = conn->expected_length;
+        }
+    }
+
+    if (conn->buffer_length < conn->expected_length) {
+        return 0;
+    }
+
+    conn->request_length = conn->expected_length;
+
+    return 1;
+}
+
+/**
+ * Decides whether the connection is kept open after the request at the front of the buffer:
+ * HTTP/1.1 keeps it alive unless the client sends 'Connection: close', HTTP/1.0 closes it unless
+ * the client asks for 'Connection: keep-alive'.
+ */
+void server_connection_set_keep_alive(Connection *conn, size_t headers_length) {
+    size_t value_length;
+
+    const char *request_line_end = find_crlf(conn->buffer, conn->buffer + headers_length + 2);
+    unsigned short http_1_1 = request_line_end - conn->buffer >= 8 && strncmp(request_line_end - 8, "HTTP/1.1", 8) == 0;
+
+    conn->keep_alive = http_1_1;
+
+    const char *connection = server_connection_find_header(conn->buffer, headers_length, "Connection", &value_length);
+    if (connection != NULL) {
+        if (value_length == 5 && strncasecmp(connection, "close", 5) == 0) {
+            conn->keep_alive = 0;
+        } else if (value_length == 10 && strncasecmp(connection, "keep-alive", 10) == 0) {
+            conn->keep_alive = 1;
+        }
+    }
+}
+
+/**
+ * Discards the request that was just handled and moves any pipelined bytes to the front of the
+ * buffer. A buffer that was grown for a large body is shrunk back, so a connection sitting idle
+ * after an upload doesn't hold on to it. The next request is handled with the settings current at
+ * this point, which may have been reloaded since the previous one.
+ *
+ * @return      1 if the buffer already holds the next complete request, 0 if it doesn't, -1 if the
+ *              next request was rejected and the connection must be closed.
+ */
+int server_connection_next_request(Connection *conn) {
+    size_t remaining_length = conn->buffer_length - conn->request_length;
+
+    memmove(conn->buffer, conn->buffer + conn->request_length, remaining_length);
+    conn->buffer_length = remaining_length;
+    conn->buffer[conn->buffer_length] = '\0';
+    conn->request_length = 0;
+    conn->headers_scanned = 0;
+    conn->expected_length = 0;
+
+    const ServerSettings *settings = server_settings_acquire();
+    server_settings_release(conn->settings);
+    conn->settings = settings;
+
+    if (conn->buffer_capacity > CONNECTION_INITIAL_BUFFER_SIZE && remaining_length <= CONNECTION_INITIAL_BUFFER_SIZE) {
+        char *new_buffer = (char *)realloc(conn->buffer, CONNECTION_INITIAL_BUFFER_SIZE * (sizeof *conn->buffer) + 1);
+        if (new_buffer != NULL) {
+            conn->buffer = new_buffer;
+            conn->buffer_capacity = CONNECTION_INITIAL_BUFFER_SIZE;
+        }
+    }
+
+    if (remaining_length == 0) {
+        conn->request_started = 0;
+        return 0;
+    }
+
+    /** The next request's clock starts now, not when its bytes arrived behind the previous one */
+    conn->request_started = server_connection_clock();
+
+    return server_connection_frame_request(conn);
+}
+
+/**
+ * Answers a request that can't be handled before it was read in full and marks the connection to
+ * be closed: the rest of what the client sent is never going to be read.
+ *
+ * @param       status_line Status code and reason phrase, e.g. "413 Content Too Large".
+ * @return      Always -1, so callers can return it as is.
+ */
+int server_connection_reject(Connection *conn, const char *status_line) {
+    char response[128];
+    int response_length = snprintf(response, sizeof response,
+                                   "HTTP/1.1 %s\r\n"
+                                   "Content-Length: 0\r\n"
+                                   "Connection: close\r\n"
+                                   "\r\n",
+                                   status_line);
+
+    /** Best effort, the connection is closed right after either way */
+    send(conn->fd, response, response_length, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+    conn->keep_alive = 0;
+
+    return -1;
+}
+
+/**
+ * Checks that every header line starts with a name directly followed by its colon. HTTP/1.1
+ * forbids whitespace between the two (RFC 9112, section 5.1), and a line starting with whitespace
+ * would continue the previous header (obsolete line folding), which isn't supported either.
+ *
+ * @param       headers Start of the request, the request line is skipped.
+ * @param       headers_length How many bytes of headers can be scanned, up to the empty line.
+ * @return      1 if every header line is well formed, 0 otherwise.
+ */
+int server_connection_header_names_valid(const char *headers, size_t headers_length) {
+    const char *headers_end = headers + headers_length;
+
+    /** Skip the request line, headers start after the first "\r\n" */
+    const char *line = find_crlf(headers, headers_end);
+
+    while (line != NULL && line + 2 < headers_end) {
+        line += 2;
+
+        const char *line_end = find_crlf(line, headers_end);
+        if (line_end == NULL) {
+            line_end = headers_end;
+        }
+
+        const char *colon = memchr(line, ':', line_end - line);
+        if (colon == NULL || colon == line || memchr(line, ' ', colon - line) != NULL || memchr(line, '\t', colon - line) != NULL) {
+            return 0;
+        }
+
+        line = line_end;
+    }
+
+    return 1;
+}
+
+/**
+ * Finds the value of a header inside a raw headers block. The header name is matched without case
+ * sensitivity and leading/trailing whitespace is not part of the returned value.
+ *
+ * @param       headers Start of the request (or of the headers block).
+ * @param       headers_length How many bytes of headers can be scanned.
+ * @param[out]  value_length Length of the header value.
+ * @return      Pointer to the first character of the value, NULL if the header is not present.
+ */
+const char *server_connection_find_header(const char *headers, size_t headers_length, const char *name, size_t *value_length) {
+    size_t name_length = strlen(name);
+    const char *headers_end = headers + headers_length;
+
+    /** Skip the request line, headers start after the first "\r\n" */
+    const char *line = find_crlf(headers, headers_end);
+
+    while (line != NULL && line + 2 < headers_end) {
+        line += 2;
+
+        const char *line_end = find_crlf(line, headers_end);
+        if (line_end == NULL) {
+            line_end = headers_end;
+        }
+
+        if ((size_t)(line_end - line) > name_length && line[name_length] == ':' && strncasecmp(line, name, name_length) == 0) {
+            const char *value = line + name_length + 1;
+            while (value < line_end && (*value == ' ' || *value == '\t')) {
+                value++;
+            }
+
+            const char *value_end = line_end;
+            while (value_end > value && (*(value_end - 1) == ' ' || *(value_end - 1) == '\t')) {
+                value_end--;
+            }
+
+            *value_length = value_end - value;
+            return value;
+        }
+
+        line = line_end;
+    }
+
+    return NULL;
+}
+
+/**
+ * When the connection must be closed if nothing changes meanwhile, depending on where it stands:
+ *  - idle between requests: KEEP_ALIVE_TIMEOUT after the last response (or the connection opening),
+ *  - reading headers: HEADER_TIMEOUT after the first byte of the request,
+ *  - reading the body: BODY_TIMEOUT after the headers were complete,
+ *  - writing the response: KEEP_ALIVE_TIMEOUT after the client last took any of it.
+ * Whatever it stands, a request never gets longer than REQUEST_TIMEOUT from its first byte to the
+ * last byte of its response.
+ *
+ * Meaningless for a connection in CONNECTION_STATE_PROCESSING, workers aren't interrupted.
+ */
+time_t server_connection_deadline(Connection *conn) {
+    const ServerSettings *settings = conn->settings;
+    time_t deadline;
+
+    if (conn->state == CONNECTION_STATE_WRITING) {
+        deadline = conn->last_active + settings->keep_alive_timeout;
+    } else if (conn->buffer_length == 0) {
+        return conn->last_active + settings->keep_alive_timeout;
+    } else if (conn->expected_length == 0) {
+        deadline = conn->request_started + settings->header_timeout;
+    } else {
+        deadline = conn->body_started + settings->body_timeout;
+    }
+
+    if (conn->request_started != 0 && conn->request_started + (time_t)settings->request_timeout < deadline) {
+        deadline = conn->request_started + settings->request_timeout;
+    }
+
+    return deadline;
+}
+
+/**
+ * Closes a connection whose deadline passed. A client that stalled in the middle of sending its
+ * request is told so with a 408 first, an idle one or one not reading its response is just closed.
+ */
+void server_connection_expire(Connection *conn) {
+    if (conn->state == CONNECTION_STATE_READING && conn->buffer_length > 0) {
+        server_connection_reject(conn, "408 Request Timeout");
+    }
+
+    server_connection_close(conn);
+}
+
+time_t server_connection_clock(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+/**
+ * Writes to the (non-blocking) socket as much of a response as it takes right now. Whatever doesn't
+ * fit is copied into the connection's pending output and sent by the event loop once the client
+ * reads, so the caller never waits on a slow client. Once output is pending, everything written
+ * after it is queued behind it to keep the bytes in order.
+ *
+ * @param       iov Modified, entries that were sent are consumed.
+ * @param       flags Passed on to sendmsg.
+ * @return      0 if the bytes were sent or queued, -1 if the connection is broken.
+ */
+int server_connection_write(Connection *conn, struct iovec *iov, int iovcnt, int flags) {
+    struct msghdr message;
+    memset(&message, 0, sizeof message);
+
+    while (iovcnt > 0 && conn->output_head == NULL) {
+        message.msg_iov = iov;
+        message.msg_iovlen = iovcnt;
+
+        ssize_t written = sendmsg(conn->fd, &message, flags | MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+
+            return -1;
+        }
+
+        while (iovcnt > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+
+    if (iovcnt == 0) {
+        return 0;
+    }
+
+    /** The socket buffer is full, the rest of the iovecs goes into a single chunk */
+    size_t length = 0;
+
+    int i;
+    for (i = 0; i < iovcnt; i++) {
+        length += iov[i].iov_len;
+    }
+
+    OutputChunk *chunk = (OutputChunk *)malloc(sizeof(OutputChunk) + length);
+    if (chunk == NULL) {
+        fprintf(stderr, "Failed to allocate memory for chunk\nError code: %d\n", errno);
+        return -1;
+    }
+
+    chunk->file_fd = -1;
+    chunk->offset = 0;
+    chunk->length = length;
+
+    char *data = (char *)(chunk + 1);
+    for (i = 0; i < iovcnt; i++) {
+        memcpy(data, iov[i].iov_base, iov[i].iov_len);
+        data += iov[i].iov_len;
+    }
+
+    server_connection_queue_output(conn, chunk);
+
+    return 0;
+}
+
+/**
+ * Sends length bytes of a file starting at offset, with sendfile so they never leave the kernel.
+ * The file offset isn't used nor moved. What the socket doesn't take is queued as a range of a
+ * duplicate of file_fd, the caller may close its own fd as soon as this returns.
+ *
+ * @return      0 if the bytes were sent or queued, -1 on error.
+ */
+int server_connection_write_file(Connection *conn, int file_fd, off_t offset, size_t length) {
+    while (length > 0 && conn->output_head == NULL) {
+        ssize_t sent = sendfile(conn->fd, file_fd, &offset, length);
+        if (sent == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+
+            fprintf(stderr, "Failed to send file\nError code: %d\n", errno);
+            return -1;
+        }
+
+        /** The file got shorter since it was sized, the response can't be completed */
+        if (sent == 0) {
+            fprintf(stderr, "File truncated while being sent\nError code: %d\n", errno);
+            return -1;
+        }
+
+        length -= sent;
+    }
+
+    if (length == 0) {
+        return 0;
+    }
+
+    OutputChunk *chunk = (OutputChunk *)malloc(sizeof(OutputChunk));
+    if (chunk == NULL) {
+        fprintf(stderr, "Failed to allocate memory for chunk\nError code: %d\n", errno);
+        return -1;
+    }
+
+    chunk->file_fd = fcntl(file_fd, F_DUPFD_CLOEXEC, 0);
+    if (chunk->file_fd == -1) {
+        fprintf(stderr, "Failed to duplicate file fd\nError code: %d\n", errno);
+        free(chunk);
+        return -1;
+    }
+
+    chunk->offset = offset;
+    chunk->length = length;
+
+    server_connection_queue_output(conn, chunk);
+
+    return 0;
+}
+
+/**
+ * Sends as much of the pending output as the socket takes. Called by the event loop when a
+ * connection in CONNECTION_STATE_WRITING becomes writable.
+ *
+ * @return      1 once nothing is pending anymore, 0 if the socket is full again, -1 on error.
+ */
+int server_connection_flush(Connection *conn) {
+    while (conn->output_head != NULL) {
+        OutputChunk *chunk = conn->output_head;
+        ssize_t sent;
+
+        if (chunk->file_fd == -1) {
+            sent = send(conn->fd, (char *)(chunk + 1) + chunk->offset, chunk->length, MSG_DONTWAIT | MSG_NOSIGNAL);
+        } else {
+            sent = sendfile(conn->fd, chunk->file_fd, &chunk->offset, chunk->length);
+        }
+
+        if (sent == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
+            }
+
+            return -1;
+        }
+
+        if (sent == 0) {
+            fprintf(stderr, "File truncated while being sent\nError code: %d\n", errno);
+            return -1;
+        }
+
+        /** sendfile already moved the offset forward */
+        if (chunk->file_fd == -1) {
+            chunk->offset += sent;
+        }
+
+        chunk->length -= sent;
+        conn->last_active = server_connection_clock();
+
+        if (chunk->length == 0) {
+            conn->output_head = chunk->next;
+            server_connection_free_output(chunk);
+        }
+    }
+
+    conn->output_tail = NULL;
+
+    return 1;
+}
+
+/**
+ * Waits for the pending output to reach the client, for a worker producing a response piece by piece
+ * that can't let it pile up in memory.
+ *
+ * This is the one place a worker blocks on a client. A streamed page is rendered on the worker's
+ * stack, in the middle of a template walk that can't be parked with the event loop and resumed
+ * later, so the choice is between holding the worker and holding the whole page in memory. How long
+ * a client can hold it is capped twice:
+ *  - the request still has to be done REQUEST_TIMEOUT after its first byte, like the event loop
+ *    enforces while reading requests and sending the rest of responses,
+ *  - every KEEP_ALIVE_TIMEOUT the client must have read CONNECTION_DRAIN_MIN_RATE bytes per second,
+ *    so trickling a byte now and then doesn't count as reading.
+ * Responses that aren't streamed never get here, their unsent bytes are left to the event loop (see
+ * server_connection_write).
+ *
+ * @return      0 once nothing is pending, -1 if the client is too slow or the connection is broken.
+ */
+int server_connection_drain(Connection *conn) {
+    const ServerSettings *settings = conn->settings;
+    time_t deadline = conn->request_started + settings->request_timeout;
+
+    time_t window_started = server_connection_clock();
+    size_t window_remaining = (size_t)-1;
+
+    int flushed;
+    while ((flushed = server_connection_flush(conn)) == 0) {
+        time_t now = server_connection_clock();
+
+        if (conn->request_started != 0 && now >= deadline) {
+            fprintf(stderr, "Request timeout reached while the client reads the response\nError code: %d\n", errno);
+            return -1;
+        }
+
+        /**
+         * The socket only turns writable once a good part of its buffer is free, which a slow client
+         * can take long to get to. How much it read is told by what is left to send instead: the
+         * bytes the socket still holds plus the pending output, which only shrinks while draining.
+         */
+        int queued;
+        if (ioctl(conn->fd, SIOCOUTQ, &queued) == -1) {
+            fprintf(stderr, "Failed to get the bytes queued on the socket\nError code: %d\n", errno);
+            return -1;
+        }
+
+        size_t remaining = (size_t)queued;
+
+        OutputChunk *chunk;
+        for (chunk = conn->output_head; chunk != NULL; chunk = chunk->next) {
+            remaining += chunk->length;
+        }
+
+        if (window_remaining == (size_t)-1) {
+            window_remaining = remaining;
+        } else if (now - window_started >= (time_t)settings->keep_alive_timeout) {
+            size_t required = (size_t)(now - window_started) * CONNECTION_DRAIN_MIN_RATE;
+            if (required > window_remaining) {
+                required = window_remaining;
+            }
+
+            if (window_remaining - remaining < required) {
+                fprintf(stderr, "Client reads the response too slowly\nError code: %d\n", errno);
+                return -1;
+            }
+
+            window_started = now;
+            window_remaining = remaining;
+        }
+
+        struct pollfd writable;
+        writable.fd = conn->fd;
+        writable.events = POLLOUT;
+
+        if (poll(&writable, 1, CONNECTION_DRAIN_POLL_INTERVAL) == -1 && errno != EINTR) {
+            fprintf(stderr, "Failed to wait for the client to read\nError code: %d\n", errno);
+            return -1;
+        }
+    }
+
+    return flushed == 1 ? 0 : -1;
+}
+
+void server_connection_queue_output(Connection *conn, OutputChunk *chunk) {
+    chunk->next = NULL;
+
+    if (conn->output_tail != NULL) {
+        conn->output_tail->next = chunk;
+    } else {
+        conn->output_head = chunk;
+    }
+
+    conn->output_tail = chunk;
+}
+
+void server_connection_free_output(OutputChunk *chunk) {
+    if (chunk->file_fd != -1) {
+        close(chunk->file_fd);
+    }
+
+    free(chunk);
+}
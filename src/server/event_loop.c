@@ -0,0 +1,429 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "globals.h"
+#include "server/server.h"
+
+extern Connection *connections;
+extern volatile size_t connections_high_water;
+
+int server_accept_connections(EventLoop *loop);
+void server_handle_client_event(EventLoop *loop, Connection *conn, unsigned int events);
+void server_handle_writable_event(EventLoop *loop, Connection *conn, unsigned int events);
+void server_dispatch_connection(EventLoop *loop, Connection *conn);
+
+/**
+ * Creates the epoll instance and registers the (already listening) server socket in it. The server
+ * socket is switched to non-blocking mode so the loop can drain the accept queue on every wake up.
+ *
+ * @param       dispatch Called from the event loop thread with the client_socket of every
+ *              connection that holds a complete request.
+ * @param       worker_index Handed to dispatch as is.
+ * @param       admission Limit new requests are checked against before they are read, see
+ *              server_event_loop_shed.
+ * @param       admission_per_batch Whether the limit is on the new requests of each batch of events,
+ *              for a loop handling its requests itself, rather than on the requests in flight.
+ */
+int server_event_loop_init(EventLoop *loop, int server_socket, ServerDispatch dispatch, unsigned short worker_index, AdmissionControl *admission, unsigned short admission_per_batch) {
+    loop->epoll_fd = -1;
+    loop->listening_socket = -1;
+    loop->dispatch = dispatch;
+    loop->worker_index = worker_index;
+    loop->drain_deadline = 0;
+    loop->admission = admission;
+    loop->admission_per_batch = admission_per_batch;
+    loop->batch_admitted = 0;
+    loop->woke_at = 0;
+    loop->accept_paused = 0;
+
+    int flags = fcntl(server_socket, F_GETFL, 0);
+    if (flags == -1 || fcntl(server_socket, F_SETFL, flags | O_NONBLOCK) == -1) {
+        fprintf(stderr, "Failed to set server socket to non-blocking mode\nError code: %d\n", errno);
+        return -1;
+    }
+
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd == -1) {
+        fprintf(stderr, "Failed to create epoll instance\nError code: %d\n", errno);
+        return -1;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof event);
+    event.events = EPOLLIN | EPOLLET;
+    event.data.fd = server_socket;
+
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, server_socket, &event) == -1) {
+        fprintf(stderr, "Failed to register server socket in epoll instance\nError code: %d\n", errno);
+        close(loop->epoll_fd);
+        loop->epoll_fd = -1;
+        return -1;
+    }
+
+    if (server_timer_wheel_init(&loop->timers, server_connection_clock()) == -1) {
+        close(loop->epoll_fd);
+        loop->epoll_fd = -1;
+        return -1;
+    }
+
+    loop->listening_socket = server_socket;
+
+    return 0;
+}
+
+/**
+ * Closes the epoll instance. Connections still open are closed later by server_connections_free,
+ * the listening socket belongs to whoever opened it.
+ */
+void server_event_loop_free(EventLoop *loop) {
+    if (loop->epoll_fd != -1) {
+        server_timer_wheel_free(&loop->timers);
+        close(loop->epoll_fd);
+        loop->epoll_fd = -1;
+    }
+
+    loop->listening_socket = -1;
+}
+
+/**
+ * Runs the reactor until the program receives a signal to exit. The loop never blocks on a single
+ * client: sockets are non-blocking and edge-triggered, and a connection is handed to dispatch only
+ * once a complete request sits in its buffer.
+ *
+ * Client sockets are registered with EPOLLONESHOT. Once a connection is dispatched it produces no
+ * more events, so the worker handling it owns it exclusively until it closes it or calls
+ * server_event_loop_watch again.
+ *
+ * Once draining is set the loop stops accepting clients and keeps running only until its
+ * connections are done, or until SHUTDOWN_TIMEOUT runs out.
+ *
+ * @return      0 when the loop exits because keep_running is 0 or it is drained, -1 on error.
+ */
+int server_event_loop_run(EventLoop *loop) {
+    struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+
+    while (keep_running) {
+        if (draining && server_event_loop_drain(loop, server_connection_clock()) == 1) {
+            return 0;
+        }
+
+        /**
+         * The timeout makes sure keep_running is checked periodically even if the exit signal is
+         * delivered to a thread other than the one waiting here. While draining it is shorter, so
+         * the loop notices soon that its last connection is gone.
+         */
+        int ready = epoll_wait(loop->epoll_fd, events, EVENT_LOOP_MAX_EVENTS, draining ? EVENT_LOOP_DRAIN_INTERVAL_MS : EVENT_LOOP_TIMEOUT_MS);
+        if (ready == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            fprintf(stderr, "Failed to wait for epoll events\nError code: %d\n", errno);
+            return -1;
+        }
+
+        loop->woke_at = server_admission_clock();
+        loop->batch_admitted = 0;
+
+        int i;
+        for (i = 0; i < ready; i++) {
+            if (events[i].data.fd == loop->listening_socket) {
+                if (server_accept_connections(loop) == -1) {
+                    return -1;
+                }
+
+                continue;
+            }
+
+            Connection *conn = server_connection_get(events[i].data.fd);
+            if (conn == NULL || conn->fd == -1) {
+                continue;
+            }
+
+            server_handle_client_event(loop, conn, events[i].events);
+        }
+
+        /** Clients left in the backlog when the process ran out of fds get no new event, see server_accept_connections */
+        if (loop->accept_paused && !draining && server_accept_connections(loop) == -1) {
+            return -1;
+        }
+
+        server_event_loop_expire(loop, server_connection_clock());
+    }
+
+    return 0;
+}
+
+/**
+ * Closes the connections whose deadline passed, see server_connection_deadline. Only the slots of
+ * the seconds elapsed since the previous call are looked at, however many connections are open.
+ * Connections being handled by a worker have no deadline in the wheel and are left alone.
+ */
+void server_event_loop_expire(EventLoop *loop, time_t now) {
+    Connection *conn = server_timer_expire(&loop->timers, now);
+
+    while (conn != NULL) {
+        Connection *next = conn->timer_next;
+        conn->timer_next = NULL;
+
+        server_connection_expire(conn);
+        conn = next;
+    }
+}
+
+/**
+ * Shuts the loop down without dropping requests. The first call stops accepting: the listening
+ * socket leaves the epoll instance and is shut down, so new clients are refused right away instead
+ * of waiting in the backlog. Every call closes the connections that sit idle between requests, while
+ * requests being read, queued, handled or sent are left to finish (responses sent while draining
+ * close their connection, see serve_connection).
+ *
+ * @return      1 once the loop has no connection left or the drain timeout ran out, 0 otherwise.
+ */
+int server_event_loop_drain(EventLoop *loop, time_t now) {
+    if (loop->drain_deadline == 0) {
+        const ServerSettings *settings = server_settings_acquire();
+        loop->drain_deadline = now + settings->shutdown_timeout;
+        server_settings_release(settings);
+
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, loop->listening_socket, NULL);
+        if (shutdown(loop->listening_socket, SHUT_RD) == -1) {
+            fprintf(stderr, "Failed to stop listening on server socket\nError code: %d\n", errno);
+        }
+    }
+
+    size_t high_water = connections_high_water;
+    size_t remaining = 0;
+
+    size_t i;
+    for (i = 0; i < high_water; i++) {
+        Connection *conn = &connections[i];
+
+        if (conn->fd == -1 || conn->event_loop != loop) {
+            continue;
+        }
+
+        if (conn->state == CONNECTION_STATE_READING && conn->buffer_length == 0) {
+            server_connection_close(conn);
+            continue;
+        }
+
+        remaining++;
+    }
+
+    if (remaining > 0 && now >= loop->drain_deadline) {
+        fprintf(stderr, "Drain timeout reached with %lu connections left\nError code: %d\n", (unsigned long)remaining, errno);
+        return 1;
+    }
+
+    return remaining == 0;
+}
+
+/**
+ * (Re-)arms a client connection in the epoll instance, handing its ownership back to the event
+ * loop. Safe to call from any thread. A connection with pending output is watched until it becomes
+ * writable, so the loop can finish sending the response, otherwise until it becomes readable.
+ *
+ * The deadline is scheduled and the socket re-armed under the timer wheel's lock: the loop can't
+ * expire the connection before it is really handed back, and if it dispatches it again right away,
+ * cancelling the deadline waits until it is in the wheel.
+ */
+int server_event_loop_watch(Connection *conn) {
+    TimerWheel *timers = &conn->event_loop->timers;
+
+    pthread_mutex_lock(&timers->mutex);
+
+    conn->last_active = server_connection_clock();
+    conn->state = conn->output_head != NULL ? CONNECTION_STATE_WRITING : CONNECTION_STATE_READING;
+    server_timer_schedule(timers, conn, server_connection_deadline(conn));
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof event);
+    event.events = (conn->state == CONNECTION_STATE_WRITING ? EPOLLOUT : EPOLLIN | EPOLLRDHUP) | EPOLLET | EPOLLONESHOT;
+    event.data.fd = conn->fd;
+
+    int retval = epoll_ctl(conn->event_loop->epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+
+    if (retval == -1 && errno == ENOENT) {
+        retval = epoll_ctl(conn->event_loop->epoll_fd, EPOLL_CTL_ADD, conn->fd, &event);
+    }
+
+    pthread_mutex_unlock(&timers->mutex);
+
+    if (retval == -1) {
+        fprintf(stderr, "Failed to watch client socket fd %d\nError code: %d\n", conn->fd, errno);
+    }
+
+    return retval;
+}
+
+/**
+ * Whether a request about to be read must be answered with 503 instead, as decided by the loop's
+ * admission control:
+ *  - in ACCEPT_MODE_QUEUE, where the loop only reads requests and workers handle them, the limit
+ *    is on the requests queued or being handled,
+ *  - in ACCEPT_MODE_REUSEPORT, where the loop handles every request itself, the limit is on the new
+ *    requests each batch of events lets in. How long after epoll_wait returned each request of the
+ *    batch gets handled adjusts the limit (see serve_client_socket): a single slow request only
+ *    nudges it, batches that keep running late shrink it until the requests they let in are served
+ *    in time.
+ *
+ * @return      1 if the request must be shed, 0 otherwise.
+ */
+int server_event_loop_shed(EventLoop *loop, Connection *conn) {
+    if (!loop->admission_per_batch) {
+        return server_admission_full(loop->admission);
+    }
+
+    if (loop->batch_admitted >= loop->admission->limit) {
+        return 1;
+    }
+
+    loop->batch_admitted++;
+
+    return 0;
+}
+
+/**
+ * Edge-triggered notifications only fire once per batch of pending connections, so keep accepting
+ * until the kernel reports there is nobody else waiting.
+ */
+int server_accept_connections(EventLoop *loop) {
+    while (1) {
+        int client_socket = accept4(loop->listening_socket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_socket == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                loop->accept_paused = 0;
+                return 0;
+            }
+
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                /**
+                 * Out of resources. The remaining clients are left in the backlog, and since the
+                 * listening socket is edge-triggered no new event may ever come for them: the loop
+                 * retries on every wake up until the backlog is drained.
+                 */
+                if (!loop->accept_paused) {
+                    fprintf(stderr, "Failed to accept client socket, out of resources\nError code: %d\n", errno);
+                }
+
+                loop->accept_paused = 1;
+                return 0;
+            }
+
+            fprintf(stderr, "Failed to create client socket\nError code: %d\n", errno);
+            return -1;
+        }
+
+        if (server_connection_open(client_socket, loop) == -1) {
+            close(client_socket);
+            continue;
+        }
+
+        Connection *conn = server_connection_get(client_socket);
+
+        if (server_event_loop_watch(conn) == -1) {
+            server_connection_close(conn);
+        }
+    }
+}
+
+void server_handle_client_event(EventLoop *loop, Connection *conn, unsigned int events) {
+    if (events & EPOLLERR) {
+        server_connection_close(conn);
+        return;
+    }
+
+    if (conn->state == CONNECTION_STATE_WRITING) {
+        server_handle_writable_event(loop, conn, events);
+        return;
+    }
+
+    /** A new request (the first of the connection, or the next on a keep-alive one) is shed before any of it is read */
+    if (conn->buffer_length == 0 && !(events & (EPOLLHUP | EPOLLRDHUP)) && server_event_loop_shed(loop, conn)) {
+        server_admission_shed(conn);
+        return;
+    }
+
+    /** EPOLLHUP/EPOLLRDHUP may still come with unread data, let the read report how it ends */
+    int read_status = server_connection_read(conn);
+
+    if (read_status == -1) {
+        server_connection_close(conn);
+        return;
+    }
+
+    if (read_status == 0) {
+        if (server_event_loop_watch(conn) == -1) {
+            server_connection_close(conn);
+        }
+        return;
+    }
+
+    server_dispatch_connection(loop, conn);
+}
+
+/**
+ * Sends more of the response a worker left pending. Once it is all out, the connection carries on
+ * where the worker stopped: it is closed, the next pipelined request is dispatched, or it goes back
+ * to waiting for one.
+ */
+void server_handle_writable_event(EventLoop *loop, Connection *conn, unsigned int events) {
+    int flush_status = server_connection_flush(conn);
+
+    if (flush_status == -1) {
+        server_connection_close(conn);
+        return;
+    }
+
+    if (flush_status == 0) {
+        if (server_event_loop_watch(conn) == -1) {
+            server_connection_close(conn);
+        }
+        return;
+    }
+
+    if (!conn->keep_alive) {
+        server_connection_close(conn);
+        return;
+    }
+
+    int next_request_status = server_connection_next_request(conn);
+
+    if (next_request_status == -1 || (next_request_status == 0 && conn->peer_closed)) {
+        server_connection_close(conn);
+        return;
+    }
+
+    if (next_request_status == 1) {
+        server_dispatch_connection(loop, conn);
+        return;
+    }
+
+    if (server_event_loop_watch(conn) == -1) {
+        server_connection_close(conn);
+    }
+}
+
+/**
+ * Hands a connection holding a complete request to a worker. Its deadline is cancelled first: it is
+ * the worker's until it calls server_event_loop_watch or closes it.
+ */
+void server_dispatch_connection(EventLoop *loop, Connection *conn) {
+    server_timer_cancel(&loop->timers, conn);
+
+    conn->state = CONNECTION_STATE_PROCESSING;
+    loop->dispatch(conn->fd, loop->worker_index);
+}
@@ -0,0 +1,207 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
+
+#define CONNECTION_INITIAL_BUFFER_SIZE 1024
+#define EVENT_LOOP_MAX_EVENTS 256
+#define EVENT_LOOP_TIMEOUT_MS 1000
+#define EVENT_LOOP_DRAIN_INTERVAL_MS 100
+#define CACHE_LINE_SIZE 64
+
+/** Who is allowed to touch a connection: the event loop while it waits for a request, a worker while it handles one */
+#define CONNECTION_STATE_READING 0
+#define CONNECTION_STATE_PROCESSING 1
+#define CONNECTION_STATE_WRITING 2 /** The event loop flushes a response the client is reading slowly */
+
+/** How client connections reach the workers, see ServerSettings.accept_mode */
+#define ACCEPT_MODE_QUEUE 0
+#define ACCEPT_MODE_REUSEPORT 1
+
+/** Timer wheel: TIMER_WHEEL_LEVELS levels of TIMER_WHEEL_SLOTS slots, one second per slot on the first level */
+#define TIMER_WHEEL_SLOTS 64
+#define TIMER_WHEEL_SLOT_BITS 6
+#define TIMER_WHEEL_LEVELS 2
+
+#define MAX_WORKERS 1024
+#define MAX_DB_CONNECTIONS 1024
+
+typedef struct {
+    unsigned short accept_mode;
+    size_t queue_capacity; /** Client sockets waiting for a worker in ACCEPT_MODE_QUEUE, a power of two */
+    unsigned short workers; /** Threads handling requests */
+    unsigned short db_connections; /** Database connections shared by the workers, see core_db_pool_acquire */
+    size_t max_header_size; /** Request line and headers, larger requests are answered with 431 */
+    size_t max_body_size; /** Request body, larger requests are answered with 413 */
+    unsigned int shutdown_timeout; /** Seconds requests in flight get to finish once the server is asked to exit */
+    unsigned int keep_alive_timeout; /** Seconds an idle connection is kept open, or a slow reader waited for */
+    unsigned int header_timeout; /** Seconds a client gets to send the request line and headers */
+    unsigned int body_timeout; /** Seconds a client gets to send the body, once the headers are in */
+    unsigned int request_timeout; /** Seconds from the first byte of a request to the last byte of its response */
+    unsigned int admission_target_delay; /** Milliseconds a request may wait for a worker before admission shrinks, 0 to disable */
+    size_t render_flush_threshold; /** Bytes of a streamed page rendered before they are sent as a chunk, 0 to disable */
+} ServerSettings;
+
+typedef struct {
+    volatile size_t sequence;
+    int client_socket;
+} ClientSocketQueueCell;
+
+/** Lock-free bounded queue handing client sockets from the event loop to the workers */
+typedef struct {
+    ClientSocketQueueCell *cells;
+    size_t mask;
+    char padding_0[CACHE_LINE_SIZE];
+    volatile size_t enqueue_position;
+    char padding_1[CACHE_LINE_SIZE];
+    volatile size_t dequeue_position;
+    char padding_2[CACHE_LINE_SIZE];
+    sem_t available;
+} ClientSocketQueue;
+
+/**
+ * Limit on the requests queued or being handled in ACCEPT_MODE_QUEUE, adjusted from how long requests
+ * wait for a worker, see admission.c.
+ */
+typedef struct {
+    volatile size_t in_flight;
+    volatile size_t limit;
+    size_t min_limit;
+    size_t max_limit;
+    pthread_mutex_t mutex; /** Guards the fields below */
+    size_t window_admitted; /** Requests served without waiting too long since the limit last changed */
+    unsigned long last_decrease; /** Milliseconds, see server_admission_clock */
+} AdmissionControl;
+
+typedef void (*ServerDispatch)(int client_socket, unsigned short worker_index);
+
+struct Connection;
+
+/**
+ * Deadlines of the connections an event loop waits on, see timer_wheel.c. Connections are linked
+ * into the slots through their timer_* fields.
+ */
+typedef struct {
+    struct Connection *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    time_t current; /** Last second whose slot was expired */
+    pthread_mutex_t mutex; /** Workers schedule the connections they hand back */
+} TimerWheel;
+
+/**
+ * An epoll instance together with the listening socket it accepts clients from. There is a single
+ * event loop in ACCEPT_MODE_QUEUE and one per worker in ACCEPT_MODE_REUSEPORT.
+ */
+typedef struct {
+    int epoll_fd;
+    int listening_socket;
+    ServerDispatch dispatch;
+    unsigned short worker_index; /** Passed to dispatch, identifies the worker running this loop */
+    time_t drain_deadline; /** 0 until the loop starts draining */
+    AdmissionControl *admission; /** Limit new requests are checked against, see server_event_loop_shed */
+    unsigned short admission_per_batch; /** The limit is on the new requests of a batch of events, ACCEPT_MODE_REUSEPORT */
+    size_t batch_admitted; /** New requests admitted since epoll_wait last returned */
+    unsigned long woke_at; /** Milliseconds when epoll_wait last returned */
+    unsigned short accept_paused; /** Accepting stopped short of the end of the backlog, out of fds or memory */
+    TimerWheel timers;
+} EventLoop;
+
+/**
+ * Part of a response the socket couldn't take when it was sent, waiting for the client to read.
+ * Either bytes copied right after the struct, or a range of a file sent later with sendfile.
+ */
+typedef struct OutputChunk {
+    struct OutputChunk *next;
+    int file_fd; /** -1 for bytes, otherwise a duplicate of the fd the response was sent from */
+    off_t offset; /** Of the next byte to send, in the file or past the struct */
+    size_t length; /** Left to send */
+} OutputChunk;
+
+/**
+ * State the server keeps for every open client socket. Connections live in a table indexed by
+ * the socket's fd, so any part of the program holding a client_socket can find its connection
+ * without having to thread an extra pointer around.
+ */
+typedef struct Connection {
+    int fd;
+    char *buffer; /** Bytes read from the socket so far, always null-terminated */
+    size_t buffer_length;
+    size_t buffer_capacity;
+    size_t request_length; /** Length of the complete request at the front of buffer, 0 while incomplete */
+    size_t headers_scanned; /** Bytes already searched for the end of the headers */
+    size_t expected_length; /** Full length of the request at the front of buffer once its headers are in, 0 before */
+    unsigned short peer_closed;
+    unsigned short keep_alive; /** Whether the connection stays open after responding to the current request */
+    volatile int state;
+    volatile time_t last_active; /** Monotonic seconds of the last read, or of the last response sent */
+    time_t request_started; /** When the first byte of the request at the front of buffer arrived, 0 if none did yet */
+    time_t body_started; /** When the headers of that request were complete */
+    unsigned long admitted_at; /** Milliseconds when the request was queued for a worker, see server_admission_clock */
+    EventLoop *event_loop; /** The loop that accepted the connection and watches it */
+    const ServerSettings *settings; /** Snapshot the current request is handled with, see server_settings_acquire */
+    OutputChunk *output_head; /** Pending output, in the order it has to reach the client */
+    OutputChunk *output_tail;
+    struct Connection *timer_next; /** Links in the slot of event_loop->timers the connection is in */
+    struct Connection *timer_prev;
+    time_t timer_deadline;
+    short timer_slot; /** level * TIMER_WHEEL_SLOTS + slot, -1 while the connection has no deadline */
+} Connection;
+
+int server_settings_load(ServerSettings *settings, const char *file_path);
+int server_settings_publish(const ServerSettings *settings);
+const ServerSettings *server_settings_acquire(void);
+void server_settings_release(const ServerSettings *settings);
+void server_settings_free(void);
+
+int server_connections_init(void);
+void server_connections_free(void);
+Connection *server_connection_get(int client_socket);
+int server_connection_open(int client_socket, EventLoop *event_loop);
+void server_connection_close(Connection *conn);
+int server_connection_read(Connection *conn);
+int server_connection_frame_request(Connection *conn);
+int server_connection_next_request(Connection *conn);
+const char *server_connection_find_header(const char *headers, size_t headers_length, const char *name, size_t *value_length);
+time_t server_connection_clock(void);
+int server_connection_write(Connection *conn, struct iovec *iov, int iovcnt, int flags);
+int server_connection_write_file(Connection *conn, int file_fd, off_t offset, size_t length);
+int server_connection_flush(Connection *conn);
+int server_connection_drain(Connection *conn);
+time_t server_connection_deadline(Connection *conn);
+void server_connection_expire(Connection *conn);
+
+int server_client_socket_queue_init(ClientSocketQueue *queue, size_t capacity);
+void server_client_socket_queue_free(ClientSocketQueue *queue);
+int server_client_socket_queue_push(ClientSocketQueue *queue, int client_socket);
+int server_client_socket_queue_pop(ClientSocketQueue *queue);
+void server_client_socket_queue_wake_all(ClientSocketQueue *queue, unsigned int consumers_count);
+
+int server_admission_init(AdmissionControl *admission, size_t min_limit, size_t max_limit, size_t initial_limit);
+void server_admission_free(AdmissionControl *admission);
+int server_admission_acquire(AdmissionControl *admission);
+int server_admission_full(AdmissionControl *admission);
+void server_admission_shed(Connection *conn);
+void server_admission_cancel(AdmissionControl *admission);
+void server_admission_release(AdmissionControl *admission, unsigned long queued_for, unsigned int target_delay);
+void server_admission_observe(AdmissionControl *admission, unsigned long queued_for, unsigned int target_delay);
+unsigned long server_admission_clock(void);
+
+int server_event_loop_init(EventLoop *loop, int server_socket, ServerDispatch dispatch, unsigned short worker_index, AdmissionControl *admission, unsigned short admission_per_batch);
+int server_event_loop_run(EventLoop *loop);
+int server_event_loop_watch(Connection *conn);
+int server_event_loop_shed(EventLoop *loop, Connection *conn);
+void server_event_loop_expire(EventLoop *loop, time_t now);
+int server_event_loop_drain(EventLoop *loop, time_t now);
+void server_event_loop_free(EventLoop *loop);
+
+int server_timer_wheel_init(TimerWheel *wheel, time_t now);
+void server_timer_wheel_free(TimerWheel *wheel);
+void server_timer_schedule(TimerWheel *wheel, Connection *conn, time_t deadline);
+void server_timer_cancel(TimerWheel *wheel, Connection *conn);
+Connection *server_timer_expire(TimerWheel *wheel, time_t now);
+
+#endif
@@ -0,0 +1,301 @@
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <linux/limits.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "server/server.h"
+#include "utils/utils.h"
+
+#define MAX_SETTINGS_LINE_LENGTH 256
+
+/**
+ * Settings can be reloaded while requests are being handled (SIGHUP), so they are published as
+ * reference counted snapshots. A request keeps the snapshot it started with until it is done, and
+ * a snapshot is freed once the last request using it lets go of it.
+ */
+typedef struct {
+    ServerSettings settings; /** First member, so a pointer to the settings is a pointer to the snapshot */
+    volatile unsigned int references; /** One held while it is the current snapshot, one per user */
+} ServerSettingsSnapshot;
+
+ServerSettingsSnapshot *settings_current = NULL;
+pthread_mutex_t settings_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** A setting holding a plain number, stored into ServerSettings as is once it is within [min, max] */
+typedef struct {
+    const char *name;
+    size_t offset; /** Of the field in ServerSettings */
+    size_t size; /** Of the field, an unsigned short, unsigned int or size_t */
+    unsigned long min;
+    unsigned long max;
+} ServerSettingsNumber;
+
+#define SETTINGS_NUMBER(name, field, min, max) {name, offsetof(ServerSettings, field), sizeof(((ServerSettings *)0)->field), min, max}
+
+static const ServerSettingsNumber settings_numbers[] = {
+    SETTINGS_NUMBER("WORKERS", workers, 1, MAX_WORKERS),
+    SETTINGS_NUMBER("DB_CONNECTIONS", db_connections, 1, MAX_DB_CONNECTIONS),
+    SETTINGS_NUMBER("MAX_HEADER_SIZE", max_header_size, CONNECTION_INITIAL_BUFFER_SIZE, ULONG_MAX),
+    SETTINGS_NUMBER("MAX_BODY_SIZE", max_body_size, 0, ULONG_MAX),
+    SETTINGS_NUMBER("SHUTDOWN_TIMEOUT", shutdown_timeout, 0, 3600),
+    SETTINGS_NUMBER("KEEP_ALIVE_TIMEOUT", keep_alive_timeout, 1, 3600),
+    SETTINGS_NUMBER("HEADER_TIMEOUT", header_timeout, 1, 3600),
+    SETTINGS_NUMBER("BODY_TIMEOUT", body_timeout, 1, 3600),
+    SETTINGS_NUMBER("REQUEST_TIMEOUT", request_timeout, 1, 3600),
+    SETTINGS_NUMBER("ADMISSION_TARGET_DELAY", admission_target_delay, 0, 60000),
+};
+
+int server_settings_apply(ServerSettings *settings, const char *name, const char *value);
+int server_settings_parse_unsigned(const char *value, unsigned long min, unsigned long max, unsigned long *out);
+
+/**
+ * @brief      Read server tunables from a settings file. Unlike env files, settings are looked up
+ *             by name, so they can appear in any order and any of them can be left out:
+ *                  1. Each setting is on its own line, written as NAME=value.
+ *                  2. Anything after a '#' is a comment.
+ *                  3. Settings that are not present in the file keep their default value.
+ *
+ * @param[out] settings Filled with the defaults and then overridden with the values in the file.
+ * @param      file_path The path to the file, absolute or relative to project root.
+ * @return     0 if success, -1 otherwise.
+ */
+int server_settings_load(ServerSettings *settings, const char *file_path) {
+    settings->accept_mode = ACCEPT_MODE_QUEUE;
+    settings->queue_capacity = 1024;
+    settings->workers = 3;
+    settings->db_connections = 3;
+    settings->max_header_size = 8192;
+    settings->max_body_size = 1048576;
+    settings->shutdown_timeout = 10;
+    settings->keep_alive_timeout = 5;
+    settings->header_timeout = 10;
+    settings->body_timeout = 30;
+    settings->request_timeout = 60;
+    settings->admission_target_delay = 50;
+    settings->render_flush_threshold = 16384;
+
+    char file_absolute_path[PATH_MAX + 1];
+    file_absolute_path[0] = '\0';
+
+    if (file_path[0] == '/') {
+        strncpy(file_absolute_path, file_path, PATH_MAX);
+        file_absolute_path[PATH_MAX] = '\0';
+    } else if (build_absolute_path(file_absolute_path, file_path) == -1) {
+        return -1;
+    }
+
+    FILE *file = fopen(file_absolute_path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Failed to open file %s\nError code: %d\n", file_absolute_path, errno);
+        return -1;
+    }
+
+    char line[MAX_SETTINGS_LINE_LENGTH];
+    unsigned int line_number = 0;
+
+    while (fgets(line, MAX_SETTINGS_LINE_LENGTH, file) != NULL) {
+        line_number++;
+
+        /** We don't care about comments. Truncate line at the start of a comment */
+        char *hash_position = strchr(line, '#');
+        if (hash_position != NULL) {
+            *hash_position = '\0';
+        }
+
+        char *equal_sign = strchr(line, '=');
+        if (equal_sign == NULL) {
+            continue;
+        }
+
+        *equal_sign = '\0';
+
+        char *name = line;
+        char *value = equal_sign + 1;
+
+        /** Trim whitespace around both the name and the value */
+        while (isspace((unsigned char)*name)) {
+            name++;
+        }
+
+        char *name_end = name + strlen(name);
+        while (name_end > name && isspace((unsigned char)*(name_end - 1))) {
+            *(--name_end) = '\0';
+        }
+
+        while (isspace((unsigned char)*value)) {
+            value++;
+        }
+
+        char *value_end = value + strlen(value);
+        while (value_end > value && isspace((unsigned char)*(value_end - 1))) {
+            *(--value_end) = '\0';
+        }
+
+        if (server_settings_apply(settings, name, value) == -1) {
+            fprintf(stderr, "Invalid setting '%s' at line %u of %s\nError code: %d\n", name, line_number, file_path, errno);
+            fclose(file);
+            return -1;
+        }
+    }
+
+    fclose(file);
+
+    return 0;
+}
+
+int server_settings_apply(ServerSettings *settings, const char *name, const char *value) {
+    if (strcmp(name, "ACCEPT_MODE") == 0) {
+        if (strcmp(value, "queue") == 0) {
+            settings->accept_mode = ACCEPT_MODE_QUEUE;
+            return 0;
+        }
+
+        if (strcmp(value, "reuseport") == 0) {
+            settings->accept_mode = ACCEPT_MODE_REUSEPORT;
+            return 0;
+        }
+
+        return -1;
+    }
+
+    unsigned long number;
+
+    if (strcmp(name, "QUEUE_CAPACITY") == 0) {
+        if (server_settings_parse_unsigned(value, 2, ULONG_MAX, &number) == -1 || (number & (number - 1)) != 0) {
+            return -1;
+        }
+
+        settings->queue_capacity = number;
+        return 0;
+    }
+
+    if (strcmp(name, "RENDER_FLUSH_THRESHOLD") == 0) {
+        if (server_settings_parse_unsigned(value, 0, 16777216, &number) == -1 || (number > 0 && number < 1024)) {
+            return -1;
+        }
+
+        settings->render_flush_threshold = number;
+        return 0;
+    }
+
+    size_t i;
+    for (i = 0; i < sizeof settings_numbers / sizeof settings_numbers[0]; i++) {
+        const ServerSettingsNumber *setting = &settings_numbers[i];
+
+        if (strcmp(name, setting->name) != 0) {
+            continue;
+        }
+
+        if (server_settings_parse_unsigned(value, setting->min, setting->max, &number) == -1) {
+            return -1;
+        }
+
+        char *field = (char *)settings + setting->offset;
+
+        if (setting->size == sizeof(unsigned short)) {
+            *(unsigned short *)field = (unsigned short)number;
+        } else if (setting->size == sizeof(unsigned int)) {
+            *(unsigned int *)field = (unsigned int)number;
+        } else {
+            *(size_t *)field = (size_t)number;
+        }
+
+        return 0;
+    }
+
+    return -1;
+}
+
+/**
+ * Parses a setting value made of decimal digits only (no sign, no whitespace).
+ *
+ * @param[out]  out Set to the value when it is within [min, max].
+ * @return      0 if success, -1 otherwise.
+ */
+int server_settings_parse_unsigned(const char *value, unsigned long min, unsigned long max, unsigned long *out) {
+    if (*value < '0' || *value > '9') {
+        return -1;
+    }
+
+    char *end;
+    errno = 0;
+    unsigned long number = strtoul(value, &end, 10);
+    if (*end != '\0' || errno == ERANGE || number < min || number > max) {
+        return -1;
+    }
+
+    *out = number;
+    return 0;
+}
+
+/**
+ * Makes a copy of settings the current snapshot. Requests already holding the previous snapshot keep
+ * using it, the ones starting from now on get the new one.
+ */
+int server_settings_publish(const ServerSettings *settings) {
+    ServerSettingsSnapshot *snapshot = (ServerSettingsSnapshot *)malloc(sizeof(ServerSettingsSnapshot));
+    if (snapshot == NULL) {
+        fprintf(stderr, "Failed to allocate memory for snapshot\nError code: %d\n", errno);
+        return -1;
+    }
+
+    snapshot->settings = *settings;
+    snapshot->references = 1;
+
+    pthread_mutex_lock(&settings_mutex);
+    ServerSettingsSnapshot *previous = settings_current;
+    settings_current = snapshot;
+    pthread_mutex_unlock(&settings_mutex);
+
+    if (previous != NULL) {
+        server_settings_release(&previous->settings);
+    }
+
+    return 0;
+}
+
+/**
+ * @return      The current settings, valid until given back with server_settings_release. NULL if
+ *              none were published yet.
+ */
+const ServerSettings *server_settings_acquire(void) {
+    pthread_mutex_lock(&settings_mutex);
+
+    ServerSettingsSnapshot *snapshot = settings_current;
+    if (snapshot != NULL) {
+        __sync_add_and_fetch(&snapshot->references, 1);
+    }
+
+    pthread_mutex_unlock(&settings_mutex);
+
+    return snapshot != NULL ? &snapshot->settings : NULL;
+}
+
+void server_settings_release(const ServerSettings *settings) {
+    ServerSettingsSnapshot *snapshot = (ServerSettingsSnapshot *)settings;
+
+    if (snapshot == NULL || __sync_sub_and_fetch(&snapshot->references, 1) != 0) {
+        return;
+    }
+
+    free(snapshot);
+}
+
+/**
+ * Drops the current snapshot. Must be called once no connection is left.
+ */
+void server_settings_free(void) {
+    pthread_mutex_lock(&settings_mutex);
+    ServerSettingsSnapshot *snapshot = settings_current;
+    settings_current = NULL;
+    pthread_mutex_unlock(&settings_mutex);
+
+    if (snapshot != NULL) {
+        server_settings_release(&snapshot->settings);
+    }
+}
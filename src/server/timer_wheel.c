@@ -0,0 +1,184 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "server/server.h"
+
+/**
+ * Hierarchical timer wheel holding the deadline of every connection an event loop waits on.
+ * Scheduling, moving and cancelling a deadline are O(1): a connection is unlinked from one slot and
+ * linked into another, whatever the amount of connections.
+ *
+ * The first level has a slot per second for the next TIMER_WHEEL_SLOTS seconds, the second level a
+ * slot per TIMER_WHEEL_SLOTS seconds for the following ones. Each time the first level wraps around,
+ * the next slot of the second level is cascaded down into it. Deadlines further away than the
+ * second level covers wait in its last slot and are placed again when it is cascaded.
+ *
+ * Connections are linked through their timer_* fields, nothing is allocated.
+ */
+
+#define TIMER_WHEEL_SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+
+void server_timer_link(TimerWheel *wheel, Connection *conn);
+void server_timer_unlink(TimerWheel *wheel, Connection *conn);
+
+int server_timer_wheel_init(TimerWheel *wheel, time_t now) {
+    memset(wheel->slots, 0, sizeof wheel->slots);
+    wheel->current = now;
+
+    if (pthread_mutex_init(&wheel->mutex, NULL) != 0) {
+        fprintf(stderr, "Failed to initialize timer wheel mutex\nError code: %d\n", errno);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Takes the connections still in the wheel out of it, they may outlive the event loop it belongs to
+ * until server_connections_free closes them.
+ */
+void server_timer_wheel_free(TimerWheel *wheel) {
+    unsigned short level, slot;
+    for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        for (slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+            while (wheel->slots[level][slot] != NULL) {
+                server_timer_unlink(wheel, wheel->slots[level][slot]);
+            }
+        }
+    }
+
+    pthread_mutex_destroy(&wheel->mutex);
+}
+
+/**
+ * Sets the deadline of a connection, replacing the one it had. Must be called with wheel->mutex
+ * held, so the caller can hand the connection back to the event loop under the same lock (see
+ * server_event_loop_watch).
+ *
+ * @param       deadline Monotonic seconds, see server_connection_clock. A deadline already passed
+ *              expires on the next call to server_timer_expire.
+ */
+void server_timer_schedule(TimerWheel *wheel, Connection *conn, time_t deadline) {
+    if (conn->timer_slot != -1) {
+        server_timer_unlink(wheel, conn);
+    }
+
+    conn->timer_deadline = deadline;
+    server_timer_link(wheel, conn);
+}
+
+void server_timer_cancel(TimerWheel *wheel, Connection *conn) {
+    pthread_mutex_lock(&wheel->mutex);
+
+    if (conn->timer_slot != -1) {
+        server_timer_unlink(wheel, conn);
+    }
+
+    pthread_mutex_unlock(&wheel->mutex);
+}
+
+/**
+ * Advances the wheel up to now, one second at a time.
+ *
+ * @return      The connections whose deadline passed, linked through timer_next. They are no longer
+ *              in the wheel.
+ */
+Connection *server_timer_expire(TimerWheel *wheel, time_t now) {
+    Connection *expired = NULL;
+
+    pthread_mutex_lock(&wheel->mutex);
+
+    while (wheel->current < now) {
+        wheel->current++;
+
+        /** The first level wrapped around, bring the next TIMER_WHEEL_SLOTS seconds down from the second one */
+        if ((wheel->current & TIMER_WHEEL_SLOT_MASK) == 0) {
+            Connection *cascaded = wheel->slots[1][(wheel->current >> TIMER_WHEEL_SLOT_BITS) & TIMER_WHEEL_SLOT_MASK];
+
+            while (cascaded != NULL) {
+                Connection *next = cascaded->timer_next;
+                server_timer_unlink(wheel, cascaded);
+
+                /** Due this very second, the slot it would go in is the one about to be expired */
+                if (cascaded->timer_deadline <= wheel->current) {
+                    cascaded->timer_next = expired;
+                    expired = cascaded;
+                } else {
+                    server_timer_link(wheel, cascaded);
+                }
+
+                cascaded = next;
+            }
+        }
+
+        Connection *conn = wheel->slots[0][wheel->current & TIMER_WHEEL_SLOT_MASK];
+
+        while (conn != NULL) {
+            Connection *next = conn->timer_next;
+
+            if (conn->timer_deadline <= wheel->current) {
+                server_timer_unlink(wheel, conn);
+                conn->timer_next = expired;
+                expired = conn;
+            }
+
+            conn = next;
+        }
+    }
+
+    pthread_mutex_unlock(&wheel->mutex);
+
+    return expired;
+}
+
+/**
+ * Must be called with wheel->mutex held.
+ */
+void server_timer_link(TimerWheel *wheel, Connection *conn) {
+    time_t deadline = conn->timer_deadline > wheel->current ? conn->timer_deadline : wheel->current + 1;
+    time_t delta = deadline - wheel->current;
+    short slot;
+
+    if (delta < TIMER_WHEEL_SLOTS) {
+        slot = deadline & TIMER_WHEEL_SLOT_MASK;
+    } else {
+        /** Too far for the second level, wait in its furthest slot and be placed again when it is cascaded */
+        if (delta >= (TIMER_WHEEL_SLOTS - 1) * TIMER_WHEEL_SLOTS) {
+            deadline = wheel->current + (TIMER_WHEEL_SLOTS - 1) * TIMER_WHEEL_SLOTS;
+        }
+
+        slot = TIMER_WHEEL_SLOTS + ((deadline >> TIMER_WHEEL_SLOT_BITS) & TIMER_WHEEL_SLOT_MASK);
+    }
+
+    Connection **head = &wheel->slots[slot / TIMER_WHEEL_SLOTS][slot & TIMER_WHEEL_SLOT_MASK];
+
+    conn->timer_slot = slot;
+    conn->timer_prev = NULL;
+    conn->timer_next = *head;
+    if (*head != NULL) {
+        (*head)->timer_prev = conn;
+    }
+
+    *head = conn;
+}
+
+/**
+ * Must be called with wheel->mutex held.
+ */
+void server_timer_unlink(TimerWheel *wheel, Connection *conn) {
+    if (conn->timer_prev != NULL) {
+        conn->timer_prev->timer_next = conn->timer_next;
+    } else {
+        wheel->slots[conn->timer_slot / TIMER_WHEEL_SLOTS][conn->timer_slot & TIMER_WHEEL_SLOT_MASK] = conn->timer_next;
+    }
+
+    if (conn->timer_next != NULL) {
+        conn->timer_next->timer_prev = conn->timer_prev;
+    }
+
+    conn->timer_next = NULL;
+    conn->timer_prev = NULL;
+    conn->timer_slot = -1;
+}
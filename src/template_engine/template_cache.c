@@ -0,0 +1,497 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "template_engine/template_engine.h"
+#include "utils/utils.h"
+
+/**
+ * Every template of the project (the .html files under src/web/pages), read and compiled once at
+ * startup so rendering a page doesn't touch the filesystem nor parse anything. Templates are only
+ * read again when the cache is reloaded (SIGHUP). Templates are reference counted: a request rendering one keeps it alive even
+ * if it is reloaded in the meantime.
+ *
+ * Every {{ component->name }} of those templates is indexed by name as well, so a handler answering
+ * an htmx request renders the partial it needs without knowing which file it is in. Component names
+ * are unique across templates, a template reusing a name another one has doesn't load.
+ */
+
+#define TEMPLATE_CACHE_CAPACITY 64
+#define TEMPLATE_CACHE_ROOT "src/web/pages"
+
+/** Slots of the component index, a power of two. It is kept at most half full */
+#define TEMPLATE_COMPONENTS_CAPACITY 128
+
+typedef struct {
+    char *path; /** Relative to the project root, NULL for empty slots */
+    Template *template; /** NULL once the file is gone */
+    unsigned int generation; /** Of the scan that last loaded the file */
+} TemplateCacheEntry;
+
+/** A slot of the component index, open addressing on the hash of the name */
+typedef struct {
+    const char *name; /** Points into the content of the template, not null-terminated. NULL for empty slots */
+    size_t name_length;
+    TemplateCacheEntry *entry; /** Of the template the component is in */
+    size_t instruction; /** Index of its TE_OP_COMPONENT instruction */
+    size_t text_length; /** Sum of the literal text of its content */
+} TemplateComponentSlot;
+
+TemplateCacheEntry template_cache_entries[TEMPLATE_CACHE_CAPACITY];
+unsigned int template_cache_entries_count = 0;
+unsigned int template_cache_generation = 0;
+pthread_mutex_t template_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** Rebuilt whenever a template is loaded or dropped, guarded by template_cache_mutex */
+TemplateComponentSlot template_components[TEMPLATE_COMPONENTS_CAPACITY];
+unsigned int template_components_count = 0;
+
+/** Serializes reloads, which may be asked for while the previous one is still running */
+pthread_mutex_t template_cache_reload_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+int te_template_cache_add_directory(const char *directory);
+int te_template_cache_load(const char *path);
+void te_template_cache_keep(const char *path);
+TemplateCacheEntry *te_template_cache_find(const char *path);
+int te_template_cache_check_components(const Template *template, const char *path);
+void te_template_cache_index_components(void);
+TemplateComponentSlot *te_template_cache_find_component(const char *name, size_t name_length);
+
+/**
+ * Must be called before any thread starts rendering pages.
+ */
+int te_template_cache_init(void) {
+    return te_template_cache_reload();
+}
+
+/**
+ * Reads every template again and drops the ones that were deleted. Templates are replaced one by
+ * one, none is ever missing while the reload runs. A template that fails to load keeps its previous
+ * version, and the others are reloaded all the same.
+ *
+ * @return      0 if every template was loaded, -1 if any failed.
+ */
+int te_template_cache_reload(void) {
+    pthread_mutex_lock(&template_cache_reload_mutex);
+
+    template_cache_generation++;
+
+    int retval = te_template_cache_add_directory(TEMPLATE_CACHE_ROOT);
+
+    Template *removed[TEMPLATE_CACHE_CAPACITY];
+    unsigned int removed_count = 0;
+
+    pthread_mutex_lock(&template_cache_mutex);
+
+    unsigned int i;
+    for (i = 0; i < TEMPLATE_CACHE_CAPACITY; i++) {
+        TemplateCacheEntry *entry = &template_cache_entries[i];
+
+        if (entry->template != NULL && entry->generation != template_cache_generation) {
+            removed[removed_count++] = entry->template;
+            entry->template = NULL;
+        }
+    }
+
+    if (removed_count > 0) {
+        te_template_cache_index_components();
+    }
+
+    pthread_mutex_unlock(&template_cache_mutex);
+
+    pthread_mutex_unlock(&template_cache_reload_mutex);
+
+    for (i = 0; i < removed_count; i++) {
+        te_template_release(removed[i]);
+    }
+
+    return retval;
+}
+
+/**
+ * Must only be called once no thread renders pages anymore.
+ */
+void te_template_cache_free(void) {
+    unsigned int i;
+    for (i = 0; i < TEMPLATE_CACHE_CAPACITY; i++) {
+        te_template_release(template_cache_entries[i].template);
+        template_cache_entries[i].template = NULL;
+
+        free(template_cache_entries[i].path);
+        template_cache_entries[i].path = NULL;
+    }
+
+    template_cache_entries_count = 0;
+
+    memset(template_components, 0, sizeof template_components);
+    template_components_count = 0;
+}
+
+/**
+ * @param       path Relative to the project root, "src/web/pages/home/home.html" for instance.
+ * @return      The template, to give back with te_template_release once rendered. NULL if there is
+ *              no such template.
+ */
+const Template *te_template_acquire(const char *path) {
+    pthread_mutex_lock(&template_cache_mutex);
+
+    TemplateCacheEntry *entry = te_template_cache_find(path);
+    Template *template = entry != NULL ? entry->template : NULL;
+    if (template != NULL) {
+        __sync_add_and_fetch(&template->references, 1);
+    }
+
+    pthread_mutex_unlock(&template_cache_mutex);
+
+    return template;
+}
+
+/**
+ * @param[out]  component The component and the template it is in, which is kept alive until
+ *              te_component_release.
+ * @param       name "sign_up_page" for {{ component->sign_up_page }} for instance.
+ * @return      0 on success, -1 if no template has such a component.
+ */
+int te_component_acquire(TemplateComponent *component, const char *name) {
+    pthread_mutex_lock(&template_cache_mutex);
+
+    TemplateComponentSlot *slot = te_template_cache_find_component(name, strlen(name));
+    if (slot->name == NULL) {
+        pthread_mutex_unlock(&template_cache_mutex);
+        return -1;
+    }
+
+    Template *template = slot->entry->template;
+    __sync_add_and_fetch(&template->references, 1);
+
+    component->template = template;
+    component->start = slot->instruction + 1;
+    component->end = template->instructions[slot->instruction].jump;
+    component->text_length = slot->text_length;
+
+    pthread_mutex_unlock(&template_cache_mutex);
+
+    return 0;
+}
+
+void te_component_release(TemplateComponent *component) {
+    te_template_release(component->template);
+    component->template = NULL;
+}
+
+void te_template_release(const Template *template) {
+    Template *released = (Template *)template;
+
+    if (released == NULL || __sync_sub_and_fetch(&released->references, 1) != 0) {
+        return;
+    }
+
+    free(released->instructions);
+    free(released);
+}
+
+/**
+ * Loads the templates of directory and of every folder below it. One failing to load doesn't stop
+ * the others, it keeps its previous version unless it is gone.
+ *
+ * @return      0 if every template was loaded, -1 if any failed.
+ */
+int te_template_cache_add_directory(const char *directory) {
+    DIR *dir = opendir(directory);
+    if (dir == NULL) {
+        fprintf(stderr, "Failed to open folder %s\nError code: %d\n", directory, errno);
+        return -1;
+    }
+
+    int retval = 0;
+    struct dirent *dir_entry;
+    while ((dir_entry = readdir(dir)) != NULL) {
+        if (dir_entry->d_name[0] == '.') {
+            continue;
+        }
+
+        char path[PATH_MAX];
+        if (snprintf(path, sizeof path, "%s/%s", directory, dir_entry->d_name) >= (int)sizeof path) {
+            continue;
+        }
+
+        struct stat path_stat;
+        if (stat(path, &path_stat) == -1) {
+            continue;
+        }
+
+        size_t path_length = strlen(path);
+
+        if (S_ISDIR(path_stat.st_mode)) {
+            if (te_template_cache_add_directory(path) == -1) {
+                retval = -1;
+            }
+        } else if (S_ISREG(path_stat.st_mode) && path_length > 5 && strcmp(path + path_length - 5, ".html") == 0) {
+            if (te_template_cache_load(path) == -1) {
+                /** Deleted since it was listed, the reload drops it. Otherwise the previous version is still rendered */
+                if (access(path, F_OK) == 0) {
+                    te_template_cache_keep(path);
+                }
+
+                retval = -1;
+            }
+        }
+    }
+
+    closedir(dir);
+
+    return retval;
+}
+
+/**
+ * Reads and compiles a template and makes it the version rendered from now on. A template that
+ * doesn't compile is an error, the previous version (if any) stays.
+ */
+int te_template_cache_load(const char *path) {
+    int file_fd = open(path, O_RDONLY);
+    if (file_fd == -1) {
+        fprintf(stderr, "Failed to open file %s\nError code: %d\n", path, errno);
+        return -1;
+    }
+
+    struct stat file_stat;
+    if (fstat(file_fd, &file_stat) == -1) {
+        fprintf(stderr, "Failed to get status of file %s\nError code: %d\n", path, errno);
+        close(file_fd);
+        return -1;
+    }
+
+    size_t length = file_stat.st_size;
+
+    /** The struct and the content are a single allocation, freed with the last reference */
+    Template *template = (Template *)malloc(sizeof(Template) + length + 1);
+    if (template == NULL) {
+        fprintf(stderr, "Failed to allocate memory for template\nError code: %d\n", errno);
+        close(file_fd);
+        return -1;
+    }
+
+    template->references = 1;
+    template->content = (char *)(template + 1);
+    template->length = length;
+
+    size_t read_length = 0;
+    while (read_length < length) {
+        ssize_t read_now = read(file_fd, template->content + read_length, length - read_length);
+        if (read_now == -1 && errno == EINTR) {
+            continue;
+        }
+
+        if (read_now <= 0) {
+            fprintf(stderr, "Failed to read file %s\nError code: %d\n", path, errno);
+            free(template);
+            close(file_fd);
+            return -1;
+        }
+
+        read_length += read_now;
+    }
+
+    close(file_fd);
+
+    template->content[length] = '\0';
+
+    if (te_compile(template, path) == -1) {
+        free(template);
+        return -1;
+    }
+
+    pthread_mutex_lock(&template_cache_mutex);
+
+    if (te_template_cache_check_components(template, path) == -1) {
+        pthread_mutex_unlock(&template_cache_mutex);
+        free(template->instructions);
+        free(template);
+        return -1;
+    }
+
+    TemplateCacheEntry *entry = te_template_cache_find(path);
+    if (entry == NULL) {
+        unsigned int i;
+        for (i = 0; i < TEMPLATE_CACHE_CAPACITY && template_cache_entries[i].path != NULL; i++) {
+        }
+
+        if (i == TEMPLATE_CACHE_CAPACITY || (template_cache_entries[i].path = (char *)malloc(strlen(path) + 1)) == NULL) {
+            pthread_mutex_unlock(&template_cache_mutex);
+            fprintf(stderr, "Failed to add %s to the template cache\nError code: %d\n", path, errno);
+            free(template->instructions);
+            free(template);
+            return -1;
+        }
+
+        entry = &template_cache_entries[i];
+        strcpy(entry->path, path);
+        template_cache_entries_count++;
+    }
+
+    Template *previous_template = entry->template;
+    entry->template = template;
+    entry->generation = template_cache_generation;
+
+    te_template_cache_index_components();
+
+    pthread_mutex_unlock(&template_cache_mutex);
+
+    te_template_release(previous_template);
+
+    return 0;
+}
+
+/**
+ * Marks the cached version of a template as found by the current reload, so it isn't dropped.
+ */
+void te_template_cache_keep(const char *path) {
+    pthread_mutex_lock(&template_cache_mutex);
+
+    TemplateCacheEntry *entry = te_template_cache_find(path);
+    if (entry != NULL) {
+        entry->generation = template_cache_generation;
+    }
+
+    pthread_mutex_unlock(&template_cache_mutex);
+}
+
+/**
+ * There are few templates, a linear scan is enough. Must be called with template_cache_mutex held.
+ *
+ * @return      The entry for path, NULL if there is none.
+ */
+TemplateCacheEntry *te_template_cache_find(const char *path) {
+    unsigned int i;
+    for (i = 0; i < TEMPLATE_CACHE_CAPACITY; i++) {
+        if (template_cache_entries[i].path != NULL && strcmp(template_cache_entries[i].path, path) == 0) {
+            return &template_cache_entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Tells whether the components of template can be indexed once it replaces the version of path
+ * (if any): none of them may be named like a component of another template, nor like another one of
+ * the same template. Must be called with template_cache_mutex held.
+ *
+ * @return      0 if they can, -1 otherwise.
+ */
+int te_template_cache_check_components(const Template *template, const char *path) {
+    TemplateCacheEntry *entry = te_template_cache_find(path);
+    unsigned int components_count = template_components_count;
+
+    size_t i;
+    if (entry != NULL && entry->template != NULL) {
+        for (i = 0; i < entry->template->instructions_count; i++) {
+            if (entry->template->instructions[i].opcode == TE_OP_COMPONENT) {
+                components_count--;
+            }
+        }
+    }
+
+    for (i = 0; i < template->instructions_count; i++) {
+        const TemplateInstruction *instruction = &template->instructions[i];
+        if (instruction->opcode != TE_OP_COMPONENT) {
+            continue;
+        }
+
+        const TemplateComponentSlot *slot = te_template_cache_find_component(instruction->text, instruction->length);
+        if (slot->name != NULL && slot->entry != entry) {
+            fprintf(stderr, "Component %.*s of template %s is already in template %s\nError code: %d\n", (int)instruction->length, instruction->text, path, slot->entry->path, errno);
+            return -1;
+        }
+
+        size_t j;
+        for (j = 0; j < i; j++) {
+            const TemplateInstruction *previous = &template->instructions[j];
+
+            if (previous->opcode == TE_OP_COMPONENT && previous->length == instruction->length && memcmp(previous->text, instruction->text, instruction->length) == 0) {
+                fprintf(stderr, "Component %.*s appears twice in template %s\nError code: %d\n", (int)instruction->length, instruction->text, path, errno);
+                return -1;
+            }
+        }
+
+        components_count++;
+    }
+
+    if (components_count > TEMPLATE_COMPONENTS_CAPACITY / 2) {
+        fprintf(stderr, "Too many components to add template %s\nError code: %d\n", path, errno);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Indexes the components of every template from scratch, it only happens when templates are
+ * (re)loaded. Must be called with template_cache_mutex held.
+ */
+void te_template_cache_index_components(void) {
+    memset(template_components, 0, sizeof template_components);
+    template_components_count = 0;
+
+    unsigned int i;
+    for (i = 0; i < TEMPLATE_CACHE_CAPACITY; i++) {
+        TemplateCacheEntry *entry = &template_cache_entries[i];
+        if (entry->template == NULL) {
+            continue;
+        }
+
+        const TemplateInstruction *instructions = entry->template->instructions;
+
+        size_t j;
+        for (j = 0; j < entry->template->instructions_count; j++) {
+            if (instructions[j].opcode != TE_OP_COMPONENT) {
+                continue;
+            }
+
+            TemplateComponentSlot *slot = te_template_cache_find_component(instructions[j].text, instructions[j].length);
+            slot->name = instructions[j].text;
+            slot->name_length = instructions[j].length;
+            slot->entry = entry;
+            slot->instruction = j;
+            slot->text_length = 0;
+
+            size_t k;
+            for (k = j + 1; k < instructions[j].jump; k++) {
+                if (instructions[k].opcode == TE_OP_TEXT) {
+                    slot->text_length += instructions[k].length;
+                }
+            }
+
+            template_components_count++;
+        }
+    }
+}
+
+/**
+ * Must be called with template_cache_mutex held.
+ *
+ * @return      The slot of the component named name, or the empty slot where it would go (its name
+ *              is NULL then).
+ */
+TemplateComponentSlot *te_template_cache_find_component(const char *name, size_t name_length) {
+    size_t index = hash_fnv1a(name, name_length) & (TEMPLATE_COMPONENTS_CAPACITY - 1);
+
+    while (template_components[index].name != NULL) {
+        TemplateComponentSlot *slot = &template_components[index];
+
+        if (slot->name_length == name_length && memcmp(slot->name, name, name_length) == 0) {
+            return slot;
+        }
+
+        index = (index + 1) & (TEMPLATE_COMPONENTS_CAPACITY - 1);
+    }
+
+    return &template_components[index];
+}
@@ -0,0 +1,239 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "template_engine/template_engine.h"
+
+/**
+ * Turns the content of a template into a list of instructions, once when the file is loaded, so
+ * rendering it is a single walk over the instructions instead of searching the text for every
+ * placeholder on every request.
+ *
+ * Tags are written between "{{ " and " }}":
+ *      {{ name }}                                  variable, see TemplateVariable
+ *      {{ for->name }} ... {{ end for->name }}     loop, see TemplateLoop
+ *      {{ for->name->vN }}                         value N of the current row of the enclosing loop 'name'
+ *      {{ component->name }} ... {{ end component->name }}
+ *                                                  part of the template that can be rendered on its own by
+ *                                                  name (see te_render_component), not inside a loop
+ * A "{{" that is never closed is literal text.
+ */
+
+/** Loops and components open at once */
+#define TE_MAX_BLOCK_DEPTH 16
+
+int te_compile_emit(Template *template, size_t *capacity, unsigned short opcode, const char *text, size_t length);
+unsigned short te_compile_starts_with(const char *tag, size_t tag_length, const char *prefix);
+
+/**
+ * Compiles template->content into template->instructions.
+ *
+ * @param       path Only used in error messages.
+ * @return      0 on success, -1 if the template is malformed (an unbalanced block, a value read
+ *              outside of its loop) or out of memory. template->instructions is left NULL then.
+ */
+int te_compile(Template *template, const char *path) {
+    size_t capacity = 0;
+
+    template->instructions = NULL;
+    template->instructions_count = 0;
+    template->text_length = 0;
+
+    /** Indexes of the loop and component instructions not closed yet */
+    size_t blocks[TE_MAX_BLOCK_DEPTH];
+    unsigned short blocks_count = 0;
+    unsigned short loops_count = 0;
+
+    const char *position = template->content;
+    const char *content_end = template->content + template->length;
+
+    while (position < content_end) {
+        const char *tag_start = (const char *)memmem(position, content_end - position, "{{", 2);
+        const char *tag_end = tag_start != NULL ? (const char *)memmem(tag_start + 2, content_end - tag_start - 2, "}}", 2) : NULL;
+
+        if (tag_end == NULL) {
+            if (te_compile_emit(template, &capacity, TE_OP_TEXT, position, content_end - position) == -1) {
+                goto error;
+            }
+
+            break;
+        }
+
+        if (tag_start > position && te_compile_emit(template, &capacity, TE_OP_TEXT, position, tag_start - position) == -1) {
+            goto error;
+        }
+
+        position = tag_end + 2;
+
+        /** The tag without the braces and the spaces around it */
+        const char *tag = tag_start + 2;
+        while (tag < tag_end && *tag == ' ') {
+            tag++;
+        }
+
+        size_t tag_length = tag_end - tag;
+        while (tag_length > 0 && tag[tag_length - 1] == ' ') {
+            tag_length--;
+        }
+
+        unsigned short opcode;
+        const char *name = tag;
+        size_t name_length = tag_length;
+
+        if (te_compile_starts_with(tag, tag_length, "end for->")) {
+            opcode = TE_OP_END_LOOP;
+            name += 9;
+        } else if (te_compile_starts_with(tag, tag_length, "end component->")) {
+            opcode = TE_OP_END_COMPONENT;
+            name += 15;
+        } else if (te_compile_starts_with(tag, tag_length, "component->")) {
+            opcode = TE_OP_COMPONENT;
+            name += 11;
+        } else if (te_compile_starts_with(tag, tag_length, "for->")) {
+            opcode = TE_OP_LOOP;
+            name += 5;
+        } else {
+            opcode = TE_OP_VARIABLE;
+        }
+
+        name_length -= name - tag;
+
+        unsigned int value_index = 0;
+
+        /** for->name->vN reads from the loop, it doesn't open one */
+        if (opcode == TE_OP_LOOP) {
+            const char *arrow = (const char *)memmem(name, name_length, "->v", 3);
+
+            if (arrow != NULL) {
+                const char *digit;
+                for (digit = arrow + 3; digit < name + name_length && *digit >= '0' && *digit <= '9'; digit++) {
+                    value_index = value_index * 10 + (*digit - '0');
+                }
+
+                if (digit == arrow + 3 || digit != name + name_length) {
+                    fprintf(stderr, "Malformed loop value %.*s in template %s\nError code: %d\n", (int)tag_length, tag, path, errno);
+                    goto error;
+                }
+
+                opcode = TE_OP_LOOP_VALUE;
+                name_length = arrow - name;
+            }
+        }
+
+        if (te_compile_emit(template, &capacity, opcode, name, name_length) == -1) {
+            goto error;
+        }
+
+        size_t index = template->instructions_count - 1;
+        TemplateInstruction *instruction = &template->instructions[index];
+        instruction->value_index = value_index;
+
+        if (opcode == TE_OP_LOOP || opcode == TE_OP_COMPONENT) {
+            if (blocks_count == TE_MAX_BLOCK_DEPTH || (opcode == TE_OP_LOOP && loops_count == TE_MAX_LOOP_DEPTH)) {
+                fprintf(stderr, "Blocks nested too deep at %.*s in template %s\nError code: %d\n", (int)tag_length, tag, path, errno);
+                goto error;
+            }
+
+            /** Rendered on its own, a component wouldn't have the rows of the loops around it */
+            if (opcode == TE_OP_COMPONENT && loops_count > 0) {
+                fprintf(stderr, "%.*s inside a loop in template %s\nError code: %d\n", (int)tag_length, tag, path, errno);
+                goto error;
+            }
+
+            if (opcode == TE_OP_LOOP) {
+                instruction->depth = loops_count++;
+            }
+
+            blocks[blocks_count++] = index;
+            continue;
+        }
+
+        if (opcode == TE_OP_END_LOOP || opcode == TE_OP_END_COMPONENT) {
+            TemplateInstruction *opening = blocks_count > 0 ? &template->instructions[blocks[blocks_count - 1]] : NULL;
+
+            if (opening == NULL || opening->opcode != opcode - 1 || opening->length != name_length || memcmp(opening->text, name, name_length) != 0) {
+                fprintf(stderr, "Unexpected %.*s in template %s\nError code: %d\n", (int)tag_length, tag, path, errno);
+                goto error;
+            }
+
+            opening->jump = index;
+            instruction->jump = blocks[--blocks_count];
+            instruction->depth = opening->depth;
+
+            if (opcode == TE_OP_END_LOOP) {
+                loops_count--;
+            }
+
+            continue;
+        }
+
+        if (opcode == TE_OP_LOOP_VALUE) {
+            /** Resolved to the innermost enclosing loop of that name, so rendering never looks it up */
+            unsigned short i;
+            for (i = blocks_count; i > 0; i--) {
+                const TemplateInstruction *block = &template->instructions[blocks[i - 1]];
+
+                if (block->opcode == TE_OP_LOOP && block->length == name_length && memcmp(block->text, name, name_length) == 0) {
+                    instruction->depth = block->depth;
+                    break;
+                }
+            }
+
+            if (i == 0) {
+                fprintf(stderr, "%.*s outside of its loop in template %s\nError code: %d\n", (int)tag_length, tag, path, errno);
+                goto error;
+            }
+        }
+    }
+
+    if (blocks_count > 0) {
+        const TemplateInstruction *opening = &template->instructions[blocks[blocks_count - 1]];
+        fprintf(stderr, "%.*s is never closed in template %s\nError code: %d\n", (int)opening->length, opening->text, path, errno);
+        goto error;
+    }
+
+    return 0;
+
+error:
+    free(template->instructions);
+    template->instructions = NULL;
+    template->instructions_count = 0;
+
+    return -1;
+}
+
+int te_compile_emit(Template *template, size_t *capacity, unsigned short opcode, const char *text, size_t length) {
+    if (template->instructions_count == *capacity) {
+        size_t new_capacity = *capacity > 0 ? *capacity * 2 : 16;
+
+        TemplateInstruction *new_instructions = (TemplateInstruction *)realloc(template->instructions, new_capacity * sizeof(TemplateInstruction));
+        if (new_instructions == NULL) {
+            fprintf(stderr, "Failed to reallocate memory for template->instructions\nError code: %d\n", errno);
+            return -1;
+        }
+
+        template->instructions = new_instructions;
+        *capacity = new_capacity;
+    }
+
+    TemplateInstruction *instruction = &template->instructions[template->instructions_count++];
+    instruction->opcode = opcode;
+    instruction->depth = 0;
+    instruction->value_index = 0;
+    instruction->text = text;
+    instruction->length = length;
+    instruction->jump = 0;
+
+    if (opcode == TE_OP_TEXT) {
+        template->text_length += length;
+    }
+
+    return 0;
+}
+
+unsigned short te_compile_starts_with(const char *tag, size_t tag_length, const char *prefix) {
+    size_t prefix_length = strlen(prefix);
+
+    return tag_length > prefix_length && memcmp(tag, prefix, prefix_length) == 0;
+}
@@ -1,5 +1,123 @@
-int te_single_substring_swap(char *substring_to_remove, char *substring_to_add, char **string);
-int te_copy_substring_block(char **buffer, size_t tokens_positions[2], char *opening_token, char *closing_token, char **string);
-int te_multiple_substring_swap(char *opening_token, char *closing_token, size_t number_of_values, char ***substrings_to_add, char **string, size_t number_of_times);
-char *te_substring_location_find(const char *substring, const char *string, size_t start_from_position, short direction);
-int te_substring_copy_into_string_at_memory_space(const char *substring, char **string, const char *begin_address, const char *end_address);
+#ifndef TEMPLATE_ENGINE_H
+#define TEMPLATE_ENGINE_H
+
+#include <stddef.h>
+
+/** Instructions a template is compiled into, see template_compiler.c */
+#define TE_OP_TEXT 0 /** Literal text, copied as is */
+#define TE_OP_VARIABLE 1 /** {{ name }} */
+#define TE_OP_LOOP 2 /** {{ for->name }} */
+#define TE_OP_END_LOOP 3 /** {{ end for->name }} */
+#define TE_OP_LOOP_VALUE 4 /** {{ for->name->vN }} */
+#define TE_OP_COMPONENT 5 /** {{ component->name }}, rendered in place unless rendered on its own, see TemplateComponent */
+#define TE_OP_END_COMPONENT 6 /** {{ end component->name }} */
+
+/** Loops nested deeper than this don't compile */
+#define TE_MAX_LOOP_DEPTH 8
+
+/** How a field of a row is rendered, see TemplateField */
+#define TE_FIELD_STRING 0 /** A char array inside the struct, null-terminated */
+#define TE_FIELD_STRING_POINTER 1 /** A char pointer, NULL renders nothing */
+#define TE_FIELD_INT 2 /** An int, rendered in decimal */
+
+/** Per-thread output buffers larger than this are given back once released, see te_output_acquire */
+#define TE_OUTPUT_RETAINED_CAPACITY (256 * 1024)
+
+typedef struct {
+    unsigned short opcode;
+    unsigned short depth; /** Loops and loop values: how many loops enclose the loop, 0 for the outermost */
+    unsigned int value_index; /** TE_OP_LOOP_VALUE: N of ->vN */
+    const char *text; /** TE_OP_TEXT: the text, otherwise the name. Points into Template.content, not null-terminated */
+    size_t length;
+    size_t jump; /** Loops and components: index of the matching end instruction, and the other way around */
+} TemplateInstruction;
+
+/** The content of a template file, shared by every request rendering it */
+typedef struct {
+    volatile unsigned int references; /** One held by the cache, one per request rendering it */
+    char *content; /** Null-terminated */
+    size_t length;
+    TemplateInstruction *instructions; /** content compiled once when the file is loaded */
+    size_t instructions_count;
+    size_t text_length; /** Sum of the literal text, a lower bound of what a render outputs */
+} Template;
+
+/** A {{ component->name }} block, found by name among every cached template, see te_component_acquire */
+typedef struct {
+    const Template *template; /** Holds a reference, given back by te_component_release */
+    size_t start; /** Index of the first instruction of its content */
+    size_t end; /** Index of its TE_OP_END_COMPONENT instruction */
+    size_t text_length; /** Sum of the literal text of its content */
+} TemplateComponent;
+
+typedef struct {
+    const char *name;
+    const char *value; /** NULL renders nothing */
+} TemplateVariable;
+
+/** A member of the struct a loop iterates over, see TE_FIELD() */
+typedef struct {
+    unsigned short type; /** TE_FIELD_* */
+    size_t offset; /** From the start of the struct */
+} TemplateField;
+
+/** {TE_FIELD_STRING, offsetof(User, email)} for instance, to initialize TemplateField arrays */
+#define TE_FIELD(type, struct_type, member) {type, offsetof(struct_type, member)}
+
+/**
+ * An array of structs a loop of the same name iterates over, read in place. {{ for->name->vN }}
+ * renders fields[N] of the current row. A single struct is bound as an array of one row.
+ */
+typedef struct {
+    const char *name;
+    const void *rows; /** The first struct */
+    size_t rows_count;
+    size_t stride; /** Bytes from one struct to the next, usually its sizeof */
+    const TemplateField *fields;
+    size_t fields_count;
+} TemplateLoop;
+
+/** What a render fills the template with. Variables and loops missing from it render nothing */
+typedef struct {
+    const TemplateVariable *variables;
+    size_t variables_count;
+    const TemplateLoop *loops;
+    size_t loops_count;
+} TemplateContext;
+
+/**
+ * A rendered page, grown by doubling as the render goes. A streamed output hands what it holds to
+ * flush every time it reaches flush_threshold bytes and starts over, see te_output_stream.
+ */
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+    int (*flush)(void *flush_data, const char *data, size_t length); /** NULL unless streamed */
+    void *flush_data;
+    size_t flush_threshold;
+} TemplateOutput;
+
+int te_compile(Template *template, const char *path);
+
+void te_output_init(TemplateOutput *output);
+void te_output_free(TemplateOutput *output);
+int te_output_append(TemplateOutput *output, const char *text, size_t length);
+TemplateOutput *te_output_acquire(void);
+void te_output_release(TemplateOutput *output);
+void te_output_stream(TemplateOutput *output, size_t flush_threshold, int (*flush)(void *flush_data, const char *data, size_t length), void *flush_data);
+void te_context_init(TemplateContext *context);
+void te_loop_bind(TemplateLoop *loop, const char *name, const void *rows, size_t rows_count, size_t stride, const TemplateField *fields, size_t fields_count);
+int te_render(TemplateOutput *output, const Template *template, const TemplateContext *context);
+int te_render_template(TemplateOutput *output, const char *path, const TemplateContext *context);
+int te_render_component(TemplateOutput *output, const char *name, const TemplateContext *context);
+
+int te_template_cache_init(void);
+int te_template_cache_reload(void);
+void te_template_cache_free(void);
+const Template *te_template_acquire(const char *path);
+void te_template_release(const Template *template);
+int te_component_acquire(TemplateComponent *component, const char *name);
+void te_component_release(TemplateComponent *component);
+
+#endif
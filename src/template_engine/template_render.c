@@ -0,0 +1,395 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "template_engine/template_engine.h"
+
+/**
+ * Renders compiled templates (see template_compiler.c): a single pass over the instructions that
+ * appends literal text and values to the output. Loops jump back to their first instruction for
+ * every row, nothing is copied or searched for.
+ *
+ * Pages are rendered into a buffer owned by the worker thread and reused from one request to the
+ * next, so a render usually allocates nothing at all: the buffer already has room from previous
+ * pages, and it is grown up front to the length of the template's text otherwise.
+ *
+ * Values are read in place from the structs the handler already holds (see TemplateLoop), a render
+ * copies nothing but its output.
+ *
+ * Large pages can be streamed instead (see te_output_stream): the output is handed over, to be sent
+ * as a chunk, whenever it fills up to a threshold, so the start of the page leaves while the rest
+ * renders and the buffer never grows much past the threshold.
+ *
+ * Usage:
+ *      const TemplateField user_fields[] = {TE_FIELD(TE_FIELD_STRING, User, email)};
+ *
+ *      TemplateLoop loop;
+ *      te_loop_bind(&loop, "users_rows", users, users_count, sizeof(User), user_fields, 1);
+ *
+ *      TemplateContext context;
+ *      te_context_init(&context);
+ *      context.loops = &loop;
+ *      context.loops_count = 1;
+ *
+ *      TemplateOutput *output = te_output_acquire();
+ *      if (output == NULL || te_render_template(output, "src/web/pages/home/home.html", &context) == -1) { ... }
+ *      ... send output->data ...
+ *      te_output_release(output);
+ */
+
+typedef struct {
+    const TemplateLoop *loop;
+    size_t row;
+} TemplateLoopFrame;
+
+pthread_key_t te_output_key;
+pthread_once_t te_output_key_once = PTHREAD_ONCE_INIT;
+unsigned short te_output_key_created = 0;
+
+void te_output_key_create(void);
+void te_output_destroy(void *output);
+int te_output_flush(TemplateOutput *output);
+int te_render_instructions(TemplateOutput *output, const Template *template, size_t start, size_t end, size_t text_length, const TemplateContext *context);
+int te_render_field(TemplateOutput *output, const char *row, const TemplateField *field);
+const char *te_render_find_variable(const TemplateContext *context, const TemplateInstruction *instruction);
+const TemplateLoop *te_render_find_loop(const TemplateContext *context, const TemplateInstruction *instruction);
+
+void te_output_init(TemplateOutput *output) {
+    output->data = NULL;
+    output->length = 0;
+    output->capacity = 0;
+    output->flush = NULL;
+    output->flush_data = NULL;
+    output->flush_threshold = 0;
+}
+
+void te_output_free(TemplateOutput *output) {
+    free(output->data);
+    te_output_init(output);
+}
+
+/**
+ * @return      The output buffer of the calling thread, empty. It stays valid until the thread calls
+ *              te_output_release, and is freed when the thread exits. NULL if it can't be allocated.
+ */
+TemplateOutput *te_output_acquire(void) {
+    pthread_once(&te_output_key_once, &te_output_key_create);
+    if (!te_output_key_created) {
+        return NULL;
+    }
+
+    TemplateOutput *output = (TemplateOutput *)pthread_getspecific(te_output_key);
+
+    if (output == NULL) {
+        output = (TemplateOutput *)malloc(sizeof(TemplateOutput));
+        if (output == NULL) {
+            fprintf(stderr, "Failed to allocate memory for output\nError code: %d\n", errno);
+            return NULL;
+        }
+
+        te_output_init(output);
+
+        if (pthread_setspecific(te_output_key, output) != 0) {
+            fprintf(stderr, "Failed to keep the output buffer of the thread\nError code: %d\n", errno);
+            free(output);
+            return NULL;
+        }
+    }
+
+    output->length = 0;
+    output->flush = NULL;
+
+    return output;
+}
+
+/**
+ * Empties the buffer for the next request of the thread. A buffer that had to grow for an unusually
+ * large page is freed instead of being held on to.
+ */
+void te_output_release(TemplateOutput *output) {
+    if (output->capacity > TE_OUTPUT_RETAINED_CAPACITY) {
+        te_output_free(output);
+        return;
+    }
+
+    output->length = 0;
+}
+
+/**
+ * Streams the output: from now on, whenever it holds flush_threshold bytes or more they are passed to
+ * flush and the output is emptied. What is left once the render is done is up to the caller.
+ *
+ * @param       flush Returns 0 once it is done with data, -1 to abort the render.
+ */
+void te_output_stream(TemplateOutput *output, size_t flush_threshold, int (*flush)(void *flush_data, const char *data, size_t length), void *flush_data) {
+    output->flush = flush;
+    output->flush_data = flush_data;
+    output->flush_threshold = flush_threshold;
+}
+
+/**
+ * The output grows by doubling, so appending is amortized O(length). It is kept null-terminated.
+ */
+int te_output_append(TemplateOutput *output, const char *text, size_t length) {
+    if (output->length + length + 1 > output->capacity) {
+        size_t new_capacity = output->capacity > 0 ? output->capacity * 2 : 1024;
+        while (new_capacity < output->length + length + 1) {
+            new_capacity *= 2;
+        }
+
+        char *new_data = (char *)realloc(output->data, new_capacity);
+        if (new_data == NULL) {
+            fprintf(stderr, "Failed to reallocate memory for output->data\nError code: %d\n", errno);
+            return -1;
+        }
+
+        output->data = new_data;
+        output->capacity = new_capacity;
+    }
+
+    memcpy(output->data + output->length, text, length);
+    output->length += length;
+    output->data[output->length] = '\0';
+
+    if (output->flush != NULL && output->length >= output->flush_threshold) {
+        return te_output_flush(output);
+    }
+
+    return 0;
+}
+
+/**
+ * Empties a context: no variables, no loops.
+ */
+void te_context_init(TemplateContext *context) {
+    context->variables = NULL;
+    context->variables_count = 0;
+    context->loops = NULL;
+    context->loops_count = 0;
+}
+
+/**
+ * @param       rows First struct of the array, nothing is copied: it must stay valid until rendered.
+ * @param       fields What {{ for->name->v0 }}, {{ for->name->v1 }}... render, in that order.
+ */
+void te_loop_bind(TemplateLoop *loop, const char *name, const void *rows, size_t rows_count, size_t stride, const TemplateField *fields, size_t fields_count) {
+    loop->name = name;
+    loop->rows = rows;
+    loop->rows_count = rows_count;
+    loop->stride = stride;
+    loop->fields = fields;
+    loop->fields_count = fields_count;
+}
+
+/**
+ * Appends the rendered template to output.
+ *
+ * @return      0 on success, -1 if the output can't grow (or a streamed output fails to flush).
+ */
+int te_render(TemplateOutput *output, const Template *template, const TemplateContext *context) {
+    return te_render_instructions(output, template, 0, template->instructions_count, template->text_length, context);
+}
+
+/**
+ * Renders a template of the cache, see te_render.
+ *
+ * @param       path Relative to the project root, "src/web/pages/home/home.html" for instance.
+ */
+int te_render_template(TemplateOutput *output, const char *path, const TemplateContext *context) {
+    const Template *template = te_template_acquire(path);
+    if (template == NULL) {
+        fprintf(stderr, "Template %s isn't loaded\nError code: %d\n", path, errno);
+        return -1;
+    }
+
+    int retval = te_render(output, template, context);
+
+    te_template_release(template);
+
+    return retval;
+}
+
+/**
+ * Renders a single {{ component->name }} block, whichever template it is in. The htmx partials of a
+ * page are components of its template, see te_component_acquire.
+ */
+int te_render_component(TemplateOutput *output, const char *name, const TemplateContext *context) {
+    TemplateComponent component;
+    if (te_component_acquire(&component, name) == -1) {
+        fprintf(stderr, "Component %s isn't loaded\nError code: %d\n", name, errno);
+        return -1;
+    }
+
+    int retval = te_render_instructions(output, component.template, component.start, component.end, component.text_length, context);
+
+    te_component_release(&component);
+
+    return retval;
+}
+
+/**
+ * Runs the instructions from start up to end (excluded), which must not cut through a loop.
+ *
+ * @param       text_length Of the literal text in the range, the output is grown to fit it up front.
+ */
+int te_render_instructions(TemplateOutput *output, const Template *template, size_t start, size_t end, size_t text_length, const TemplateContext *context) {
+    size_t pc = start;
+
+    /** The page is at least as long as its text, grow once up front. A streamed output only ever holds up to its threshold */
+    size_t expected_length = text_length;
+    if (output->flush != NULL && expected_length > output->flush_threshold) {
+        expected_length = output->flush_threshold;
+    }
+
+    if (output->capacity < output->length + expected_length + 1) {
+        char *new_data = (char *)realloc(output->data, output->length + expected_length + 1);
+        if (new_data == NULL) {
+            fprintf(stderr, "Failed to reallocate memory for output->data\nError code: %d\n", errno);
+            return -1;
+        }
+
+        output->data = new_data;
+        output->capacity = output->length + expected_length + 1;
+    }
+
+    TemplateLoopFrame frames[TE_MAX_LOOP_DEPTH];
+
+    while (pc < end) {
+        const TemplateInstruction *instruction = &template->instructions[pc];
+        const char *value;
+        TemplateLoopFrame *frame;
+
+        switch (instruction->opcode) {
+        case TE_OP_TEXT:
+            if (te_output_append(output, instruction->text, instruction->length) == -1) {
+                return -1;
+            }
+            break;
+
+        case TE_OP_VARIABLE:
+            value = te_render_find_variable(context, instruction);
+            if (value != NULL && te_output_append(output, value, strlen(value)) == -1) {
+                return -1;
+            }
+            break;
+
+        case TE_OP_LOOP:
+            frame = &frames[instruction->depth];
+            frame->loop = te_render_find_loop(context, instruction);
+            frame->row = 0;
+
+            /** Nothing to iterate over, carry on after the loop */
+            if (frame->loop == NULL || frame->loop->rows_count == 0) {
+                pc = instruction->jump;
+            }
+            break;
+
+        case TE_OP_END_LOOP:
+            frame = &frames[instruction->depth];
+
+            if (++frame->row < frame->loop->rows_count) {
+                pc = instruction->jump;
+            }
+            break;
+
+        case TE_OP_LOOP_VALUE:
+            frame = &frames[instruction->depth];
+
+            if (instruction->value_index < frame->loop->fields_count) {
+                const char *row = (const char *)frame->loop->rows + frame->row * frame->loop->stride;
+
+                if (te_render_field(output, row, &frame->loop->fields[instruction->value_index]) == -1) {
+                    return -1;
+                }
+            }
+            break;
+
+        default:
+            /** Component boundaries, their content renders in place */
+            break;
+        }
+
+        pc++;
+    }
+
+    return 0;
+}
+
+int te_render_field(TemplateOutput *output, const char *row, const TemplateField *field) {
+    const char *value;
+    char number[24];
+
+    switch (field->type) {
+    case TE_FIELD_STRING:
+        value = row + field->offset;
+        break;
+
+    case TE_FIELD_STRING_POINTER:
+        value = *(const char *const *)(row + field->offset);
+        if (value == NULL) {
+            return 0;
+        }
+        break;
+
+    case TE_FIELD_INT:
+        return te_output_append(output, number, sprintf(number, "%d", *(const int *)(row + field->offset)));
+
+    default:
+        return 0;
+    }
+
+    return te_output_append(output, value, strlen(value));
+}
+
+int te_output_flush(TemplateOutput *output) {
+    if (output->flush(output->flush_data, output->data, output->length) == -1) {
+        return -1;
+    }
+
+    output->length = 0;
+    output->data[0] = '\0';
+
+    return 0;
+}
+
+void te_output_key_create(void) {
+    if (pthread_key_create(&te_output_key, &te_output_destroy) != 0) {
+        fprintf(stderr, "Failed to create the output buffer key\nError code: %d\n", errno);
+        return;
+    }
+
+    te_output_key_created = 1;
+}
+
+void te_output_destroy(void *output) {
+    te_output_free((TemplateOutput *)output);
+    free(output);
+}
+
+const char *te_render_find_variable(const TemplateContext *context, const TemplateInstruction *instruction) {
+    size_t i;
+    for (i = 0; i < context->variables_count; i++) {
+        const TemplateVariable *variable = &context->variables[i];
+
+        if (strncmp(variable->name, instruction->text, instruction->length) == 0 && variable->name[instruction->length] == '\0') {
+            return variable->value;
+        }
+    }
+
+    return NULL;
+}
+
+const TemplateLoop *te_render_find_loop(const TemplateContext *context, const TemplateInstruction *instruction) {
+    size_t i;
+    for (i = 0; i < context->loops_count; i++) {
+        const TemplateLoop *loop = &context->loops[i];
+
+        if (strncmp(loop->name, instruction->text, instruction->length) == 0 && loop->name[instruction->length] == '\0') {
+            return loop;
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,188 @@
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#else
+#define SCAN_X86 0
+#endif
+
+#include "utils/utils.h"
+
+/**
+ * Search for "\r\n", which is what splits the request line and every header line.
+ *
+ * Header lines are short, a browser sends ~20 of them averaging ~45 bytes, so looking for one line
+ * end at a time mostly pays the setup cost of whatever does the search. find_crlfs instead indexes
+ * every line end of the headers in a single pass. There is one implementation per instruction set,
+ * the vector ones compare a whole block against '\r' and, one byte further, against '\n', and only
+ * look at the positions where both match.
+ */
+
+/** Picked once by select_crlf_scanner, before any thread starts parsing requests */
+size_t (*find_crlfs_implementation)(const char *start, const char *end, const char **crlfs, size_t max_crlfs) = &find_crlfs_scalar;
+
+/**
+ * @return      The position of the '\r' of the first "\r\n" in [start, end), NULL if there is none.
+ */
+const char *find_crlf(const char *start, const char *end) {
+    const char *carriage_return = start;
+
+    while (end - carriage_return >= 2) {
+        carriage_return = memchr(carriage_return, '\r', end - carriage_return - 1);
+        if (carriage_return == NULL) {
+            return NULL;
+        }
+
+        if (carriage_return[1] == '\n') {
+            return carriage_return;
+        }
+
+        carriage_return++;
+    }
+
+    return NULL;
+}
+
+/**
+ * Finds the end of every line in [start, end) up to and including the empty line that ends a
+ * headers block.
+ *
+ * @param[out]  crlfs Position of the '\r' of every "\r\n" found, in order.
+ * @param       max_crlfs Capacity of crlfs, the search stops once it is full.
+ * @return      How many positions were written to crlfs. The last one is the empty line unless
+ *              crlfs filled up or [start, end) has no empty line.
+ */
+size_t find_crlfs(const char *start, const char *end, const char **crlfs, size_t max_crlfs) {
+    return find_crlfs_implementation(start, end, crlfs, max_crlfs);
+}
+
+/**
+ * Makes find_crlfs use the widest implementation the CPU running the program supports.
+ *
+ * @return      The name of the selected implementation.
+ */
+const char *select_crlf_scanner(void) {
+#if SCAN_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2")) {
+        find_crlfs_implementation = &find_crlfs_avx2;
+        return "avx2";
+    }
+
+    if (__builtin_cpu_supports("sse2")) {
+        find_crlfs_implementation = &find_crlfs_sse2;
+        return "sse2";
+    }
+#endif
+
+    find_crlfs_implementation = &find_crlfs_scalar;
+    return "scalar";
+}
+
+/**
+ * Shared by every implementation: the vector ones hand the tail that doesn't fill a block over to
+ * it, along with how many line ends were already found and where the current line starts.
+ */
+size_t find_crlfs_from(const char *position, const char *line_start, const char *end, const char **crlfs, size_t count, size_t max_crlfs) {
+    while (count < max_crlfs) {
+        const char *crlf = find_crlf(position, end);
+        if (crlf == NULL) {
+            break;
+        }
+
+        crlfs[count++] = crlf;
+        if (crlf == line_start) {
+            break;
+        }
+
+        position = crlf + 2;
+        line_start = position;
+    }
+
+    return count;
+}
+
+size_t find_crlfs_scalar(const char *start, const char *end, const char **crlfs, size_t max_crlfs) {
+    return find_crlfs_from(start, start, end, crlfs, 0, max_crlfs);
+}
+
+#if SCAN_X86
+
+__attribute__((target("sse2"))) size_t find_crlfs_sse2(const char *start, const char *end, const char **crlfs, size_t max_crlfs) {
+    const __m128i carriage_returns = _mm_set1_epi8('\r');
+    const __m128i line_feeds = _mm_set1_epi8('\n');
+
+    const char *block = start;
+    const char *line_start = start;
+    size_t count = 0;
+
+    /** The '\n' comparison reads one byte past the block, which must still be inside [start, end) */
+    while (end - block > 16 && count < max_crlfs) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)block);
+        __m128i next_bytes = _mm_loadu_si128((const __m128i *)(block + 1));
+        unsigned int matches = (unsigned int)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(bytes, carriage_returns), _mm_cmpeq_epi8(next_bytes, line_feeds)));
+
+        while (matches != 0) {
+            const char *crlf = block + __builtin_ctz(matches);
+
+            crlfs[count++] = crlf;
+            if (crlf == line_start || count == max_crlfs) {
+                return count;
+            }
+
+            line_start = crlf + 2;
+            matches &= matches - 1;
+        }
+
+        block += 16;
+    }
+
+    /** A "\r\n" may straddle the last block and the tail, line_start never points past it */
+    return find_crlfs_from(block > line_start ? block : line_start, line_start, end, crlfs, count, max_crlfs);
+}
+
+__attribute__((target("avx2"))) size_t find_crlfs_avx2(const char *start, const char *end, const char **crlfs, size_t max_crlfs) {
+    const __m256i carriage_returns = _mm256_set1_epi8('\r');
+    const __m256i line_feeds = _mm256_set1_epi8('\n');
+
+    const char *block = start;
+    const char *line_start = start;
+    size_t count = 0;
+
+    while (end - block > 32 && count < max_crlfs) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *)block);
+        __m256i next_bytes = _mm256_loadu_si256((const __m256i *)(block + 1));
+        unsigned int matches = (unsigned int)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(bytes, carriage_returns), _mm256_cmpeq_epi8(next_bytes, line_feeds)));
+
+        while (matches != 0) {
+            const char *crlf = block + __builtin_ctz(matches);
+
+            crlfs[count++] = crlf;
+            if (crlf == line_start || count == max_crlfs) {
+                return count;
+            }
+
+            line_start = crlf + 2;
+            matches &= matches - 1;
+        }
+
+        block += 32;
+    }
+
+    return find_crlfs_from(block > line_start ? block : line_start, line_start, end, crlfs, count, max_crlfs);
+}
+
+#else
+
+size_t find_crlfs_sse2(const char *start, const char *end, const char **crlfs, size_t max_crlfs) {
+    return find_crlfs_scalar(start, end, crlfs, max_crlfs);
+}
+
+size_t find_crlfs_avx2(const char *start, const char *end, const char **crlfs, size_t max_crlfs) {
+    return find_crlfs_scalar(start, end, crlfs, max_crlfs);
+}
+
+#endif
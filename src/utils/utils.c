@@ -214,3 +214,19 @@ int load_values_from_file(void *structure, const char *file_path_relative_to_pro
     fclose(file);
     return read_values_count;
 }
+
+/**
+ * 64-bit FNV-1a hash, cheap enough to run over whole files to tell versions of them apart.
+ */
+unsigned long hash_fnv1a(const void *data, size_t length) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    unsigned long hash = 0xcbf29ce484222325UL;
+
+    size_t i;
+    for (i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3UL;
+    }
+
+    return hash;
+}
@@ -9,5 +9,13 @@ int read_file(char *file_content, char *file_path, size_t file_size);
 int read_file_from_path_relative_to_project_root(char **buffer, const char *file_path_relative_to_project_root);
 int build_absolute_path(char *buffer, const char *path_relative_to_project_root);
 int load_values_from_file(void *structure, const char *file_path_relative_to_project_root);
+unsigned long hash_fnv1a(const void *data, size_t length);
+
+const char *find_crlf(const char *start, const char *end);
+size_t find_crlfs(const char *start, const char *end, const char **crlfs, size_t max_crlfs);
+size_t find_crlfs_scalar(const char *start, const char *end, const char **crlfs, size_t max_crlfs);
+size_t find_crlfs_sse2(const char *start, const char *end, const char **crlfs, size_t max_crlfs);
+size_t find_crlfs_avx2(const char *start, const char *end, const char **crlfs, size_t max_crlfs);
+const char *select_crlf_scanner(void);
 
 #endif
\ No newline at end of file
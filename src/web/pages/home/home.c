@@ -14,56 +14,40 @@
 #include "web/web.h"
 
 int web_home_get(int client_socket, HttpRequest *request) {
-    /** TODO: improve http response headers */
-    char response_headers[] = "HTTP/1.1 200 OK\r\n"
-                              "Content-Type: text/html\r\n"
-                              "\r\n";
+    int retval = 0;
 
-    char *template;
-    if (read_file_from_path_relative_to_project_root(&template, "src/web/pages/home/home.html") == -1) {
-        free(template);
-        template = NULL;
-        return -1;
-    }
+    TemplateVariable variables[1];
+    variables[0].name = "hello_world";
+    variables[0].value = "hello world";
 
-    char *response;
-    response = (char *)malloc((strlen(response_headers) + strlen(template)) * (sizeof *response) + 1);
-    if (response == NULL) {
-        fprintf(stderr, "Failed to allocate memory for response\nError code: %d\n", errno);
-        return -1;
-    }
+    TemplateContext context;
+    te_context_init(&context);
+    context.variables = variables;
+    context.variables_count = 1;
 
-    if (sprintf(response, "%s%s", response_headers, template) < 0) {
-        fprintf(stderr, "Failed to construct response\nError code: %d\n", errno);
-        free(template);
-        template = NULL;
-        free(response);
-        response = NULL;
+    TemplateOutput *output = te_output_acquire();
+    if (output == NULL) {
         return -1;
     }
 
-    free(template);
-    template = NULL;
-
-    if (te_single_substring_swap("{{ hello_world }}", "hello world", &response) == -1) {
-        free(response);
-        response = NULL;
-        return -1;
+    if (te_render_template(output, "src/web/pages/home/home.html", &context) == -1) {
+        retval = -1;
+        goto cleanup;
     }
 
-    size_t post_rendering_response_length = strlen(response) * sizeof(char);
+    HttpResponse http_response;
+    web_response_init(&http_response, client_socket, request, 200);
+    web_response_header(&http_response, "Content-Type", "text/html");
+    web_response_body(&http_response, output->data, output->length);
+    web_response_revalidate(&http_response, request);
 
-    if (send(client_socket, response, post_rendering_response_length, 0) == -1) {
-        fprintf(stderr, "Failed send HTTP response\nError code: %d\n", errno);
-        free(response);
-        response = NULL;
-        return -1;
+    if (web_response_send(&http_response) == -1) {
+        retval = -1;
+        goto cleanup;
     }
 
-    close(client_socket);
-
-    free(response);
-    response = NULL;
+cleanup:
+    te_output_release(output);
 
-    return 0;
+    return retval;
 }
@@ -7,16 +7,35 @@
 #include "web/web.h"
 
 int web_not_found(int client_socket, HttpRequest *request) {
-    char response[] = "HTTP/1.1 404 Not Found\r\n"
-                      "Content-Type: text/html\r\n"
-                      "\r\n"
-                      "<html><body><h1>404 Not Found</h1></body></html>";
-    if (send(client_socket, response, strlen(response), 0) == -1) {
-        fprintf(stderr, "Failed send HTTP response\nError code: %d\n", errno);
+    char response_body[] = "<html><body><h1>404 Not Found</h1></body></html>";
+
+    HttpResponse http_response;
+    web_response_init(&http_response, client_socket, request, 404);
+    web_response_header(&http_response, "Content-Type", "text/html");
+    web_response_body(&http_response, response_body, strlen(response_body));
+
+    if (web_response_send(&http_response) == -1) {
         return -1;
     }
 
-    close(client_socket);
+    return 0;
+}
+
+/**
+ * @param       allow_header "Allow: ...\r\n" line listing the methods the url does accept.
+ */
+int web_method_not_allowed(int client_socket, HttpRequest *request, const char *allow_header) {
+    char response_body[] = "<html><body><h1>405 Method Not Allowed</h1></body></html>";
+
+    HttpResponse http_response;
+    web_response_init(&http_response, client_socket, request, 405);
+    web_response_header_lines(&http_response, allow_header, strlen(allow_header));
+    web_response_header(&http_response, "Content-Type", "text/html");
+    web_response_body(&http_response, response_body, strlen(response_body));
+
+    if (web_response_send(&http_response) == -1) {
+        return -1;
+    }
 
     return 0;
 }
@@ -14,100 +14,147 @@
 #include "utils/utils.h"
 #include "web/web.h"
 
-int web_sign_up_get(int client_socket, HttpRequest *request) {
-    /** TODO: improve http response headers */
-    char response_headers[] = "HTTP/1.1 200 OK\r\n"
-                              "Content-Type: text/html\r\n"
-                              "\r\n";
-
-    char *loaded_file;
-    if (read_file_from_path_relative_to_project_root(&loaded_file, "src/web/pages/sign_up/sign-up.html") == -1) {
-        free(loaded_file);
-        loaded_file = NULL;
-        return -1;
-    }
+/** An error message is a row of its own, see the error_messages component of sign-up.html */
+const TemplateField sign_up_error_message_fields[] = {
+    {TE_FIELD_STRING_POINTER, 0}};
 
-    char *template;
-    if (te_copy_substring_block(&template, NULL, "{{ component->sign_up_page }}", "{{ end component->sign_up_page }}", &loaded_file) == -1) {
-        free(loaded_file);
-        loaded_file = NULL;
-        free(template);
-        template = NULL;
-        return -1;
-    }
+int web_sign_up_send_error_messages(int client_socket, const char *const *messages, size_t messages_count);
 
-    free(loaded_file);
-    loaded_file = NULL;
+int web_sign_up_get(int client_socket, HttpRequest *request) {
+    int retval = 0;
 
-    char *response;
-    response = (char *)malloc((strlen(response_headers) + strlen(template)) * (sizeof *response) + 1);
-    if (response == NULL) {
-        fprintf(stderr, "Failed to allocate memory for response\nError code: %d\n", errno);
-        return -1;
-    }
+    TemplateContext context;
+    te_context_init(&context);
 
-    if (sprintf(response, "%s%s", response_headers, template) < 0) {
-        fprintf(stderr, "Failed to construct response\nError code: %d\n", errno);
-        free(template);
-        template = NULL;
-        free(response);
-        response = NULL;
+    TemplateOutput *output = te_output_acquire();
+    if (output == NULL) {
         return -1;
     }
 
-    free(template);
-    template = NULL;
+    /** htmx only swaps in the form, a browser loads the whole page */
+    const char *component = web_utils_hx_request(request) ? "sign_up_form" : "sign_up_page";
 
-    size_t post_rendering_response_length = strlen(response) * sizeof(char);
-
-    if (send(client_socket, response, post_rendering_response_length, 0) == -1) {
-        fprintf(stderr, "Failed send HTTP response\nError code: %d\n", errno);
-        free(response);
-        response = NULL;
-        return -1;
+    if (te_render_component(output, component, &context) == -1) {
+        retval = -1;
+        goto cleanup;
     }
 
-    close(client_socket);
+    HttpResponse http_response;
+    web_response_init(&http_response, client_socket, request, 200);
+    web_response_header(&http_response, "Content-Type", "text/html");
+    web_response_header(&http_response, "Vary", "HX-Request");
+    web_response_body(&http_response, output->data, output->length);
+    web_response_revalidate(&http_response, request);
+
+    if (web_response_send(&http_response) == -1) {
+        retval = -1;
+        goto cleanup;
+    }
 
-    free(response);
-    response = NULL;
+cleanup:
+    te_output_release(output);
 
-    return 0;
+    return retval;
 }
 
-int web_sign_up_create_user_post(int client_socket, HttpRequest *request, int conn_index) {
+int web_sign_up_create_user_post(int client_socket, HttpRequest *request) {
     /**
      * This endpoint may return:
      * - (Error) HTML partials to display error messages (invalid inputs, server errors...).
      * - (Success) Redirect instructions in the headers
      */
 
-    char response_headers[] = "HTTP/1.1 200 OK\r\n"
-                              "Content-Type: text/html\r\n"
-                              "\r\n";
+    int retval = 0;
 
     SignUpCreateUserInput input;
-    web_utils_url_decode(&request->body);
+    input.email = NULL;
+    input.password = NULL;
+    input.repeat_password = NULL;
+
+    /**
+     * The body is the last thing in the request buffer and the buffer is null-terminated right after
+     * the request, so it can be read as a string. Values are decoded once they are split apart, an
+     * encoded '&' or '=' must not be taken for a separator.
+     */
+    if (web_utils_parse_value(&input.email, "email", request->body.start) == -1 || web_utils_parse_value(&input.password, "password", request->body.start) == -1 ||
+        web_utils_parse_value(&input.repeat_password, "repeat_password", request->body.start) == -1) {
+        /** htmx shows the messages in the form, and only swaps in the responses of requests that succeeded */
+        if (web_utils_hx_request(request)) {
+            const char *messages[] = {"Please fill in every field."};
+            retval = web_sign_up_send_error_messages(client_socket, messages, 1);
+        } else if (web_response_send_status(client_socket, 400) == -1) {
+            retval = -1;
+        }
+
+        goto cleanup;
+    }
 
-    web_utils_parse_value(&input.email, "email", request->body);
-    web_utils_parse_value(&input.password, "password", request->body);
-    web_utils_parse_value(&input.repeat_password, "repeat_password", request->body);
+    web_utils_url_decode(&input.email);
+    web_utils_url_decode(&input.password);
+    web_utils_url_decode(&input.repeat_password);
 
     SignUpCreateUserResult result;
     /**
      * NOTE: Maybe core_sign_up_create_user should also accept a errors buffer that is an
      *       strings array. We can send html partials with error messages to the UI.
      */
-    if (core_sign_up_create_user(&result, &input, client_socket, conn_index) == -1) {
-        return -1;
+    if (core_sign_up_create_user(&result, &input, client_socket) == -1) {
+        retval = -1;
+        goto cleanup;
+    }
+
+    if (web_response_send_status(client_socket, 200) == -1) {
+        retval = -1;
+        goto cleanup;
     }
 
-    if (send(client_socket, response_headers, strlen(response_headers), 0) == -1) {
-        fprintf(stderr, "Failed send HTTP response\nError code: %d\n", errno);
+cleanup:
+    free(input.email);
+    input.email = NULL;
+    free(input.password);
+    input.password = NULL;
+    free(input.repeat_password);
+    input.repeat_password = NULL;
+
+    return retval;
+}
+
+/**
+ * Answers an htmx request with the error_messages partial, listing messages.
+ */
+int web_sign_up_send_error_messages(int client_socket, const char *const *messages, size_t messages_count) {
+    int retval = 0;
+
+    TemplateLoop loop;
+    te_loop_bind(&loop, "message_item", messages, messages_count, sizeof(const char *), sign_up_error_message_fields, 1);
+
+    TemplateContext context;
+    te_context_init(&context);
+    context.loops = &loop;
+    context.loops_count = 1;
+
+    TemplateOutput *output = te_output_acquire();
+    if (output == NULL) {
         return -1;
     }
 
-    close(client_socket);
+    if (te_render_component(output, "error_messages", &context) == -1) {
+        retval = -1;
+        goto cleanup;
+    }
+
+    HttpResponse http_response;
+    web_response_init(&http_response, client_socket, NULL, 200);
+    web_response_header(&http_response, "Content-Type", "text/html");
+    web_response_body(&http_response, output->data, output->length);
+
+    if (web_response_send(&http_response) == -1) {
+        retval = -1;
+        goto cleanup;
+    }
+
+cleanup:
+    te_output_release(output);
 
-    return 0;
+    return retval;
 }
@@ -0,0 +1,488 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
+
+#include "server/server.h"
+#include "utils/utils.h"
+#include "web/web.h"
+
+/**
+ * Response builder: the status line and headers are written into a buffer inside HttpResponse, the
+ * body is a list of segments pointing at memory the handler already owns (or a range of a file),
+ * and web_response_send hands both to the kernel in a single gathered send. Content-Length, Date
+ * and Connection are added by web_response_send, so no handler writes them by hand.
+ *
+ * Usage:
+ *      HttpResponse response;
+ *      web_response_init(&response, client_socket, 200);
+ *      web_response_header(&response, "Content-Type", "text/html");
+ *      web_response_body(&response, html, html_length);
+ *      if (web_response_send(&response) == -1) { ... }
+ *
+ * Pages too large to render in full before sending anything are streamed instead, with
+ * Transfer-Encoding: chunked (see web_response_stream).
+ */
+
+/** Room kept at the end of HttpResponse.headers for what web_response_send appends */
+#define RESPONSE_FINAL_HEADERS_CAPACITY 128
+
+/** Length of "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n" */
+#define RESPONSE_DATE_HEADER_LENGTH 37
+
+/**
+ * The Date header only changes once per second, formatting it for every response would be wasted
+ * work. Every thread keeps its own copy, formatted again the first time it is needed in a new
+ * second: no other thread ever writes it, so it can't change while it is being copied.
+ */
+__thread char response_date_header[RESPONSE_DATE_HEADER_LENGTH + 1];
+__thread time_t response_date_second = 0;
+
+const char *web_response_date_header(void);
+const char *web_response_reason_phrase(unsigned short status);
+void web_response_set_status(HttpResponse *response, unsigned short status);
+void web_response_remove_header(HttpResponse *response, const char *name);
+int web_response_send_chunk(HttpResponse *response, const char *data, size_t length, unsigned short last);
+
+/**
+ * @param       request The request answered, a HEAD gets the headers of the response only. NULL
+ *              when there is no parsed request to answer.
+ * @param       status HTTP status code, the reason phrase is filled in from it.
+ */
+void web_response_init(HttpResponse *response, int client_socket, const HttpRequest *request, unsigned short status) {
+    response->client_socket = client_socket;
+    response->status = status;
+    response->headers_length = sprintf(response->headers, "HTTP/1.1 %u %s\r\n", status, web_response_reason_phrase(status));
+    response->headers_overflow = 0;
+    response->body_segments_count = 0;
+    response->body_length = 0;
+    response->file_fd = -1;
+    response->file_offset = 0;
+    response->chunked = 0;
+    response->headers_only = request != NULL && request->method == HTTP_METHOD_HEAD;
+}
+
+/**
+ * Adds a header. A header that doesn't fit makes web_response_send fail instead of sending a
+ * truncated response, so callers don't have to check every call.
+ */
+void web_response_header(HttpResponse *response, const char *name, const char *value) {
+    size_t name_length = strlen(name);
+    size_t value_length = strlen(value);
+
+    if (response->headers_length + name_length + value_length + 4 > HTTP_RESPONSE_HEADERS_CAPACITY - RESPONSE_FINAL_HEADERS_CAPACITY) {
+        response->headers_overflow = 1;
+        return;
+    }
+
+    char *position = response->headers + response->headers_length;
+    memcpy(position, name, name_length);
+    position += name_length;
+    memcpy(position, ": ", 2);
+    position += 2;
+    memcpy(position, value, value_length);
+    position += value_length;
+    memcpy(position, "\r\n", 2);
+
+    response->headers_length += name_length + value_length + 4;
+}
+
+/**
+ * Adds header lines that are already formatted, each ending in "\r\n".
+ */
+void web_response_header_lines(HttpResponse *response, const char *lines, size_t lines_length) {
+    if (response->headers_length + lines_length > HTTP_RESPONSE_HEADERS_CAPACITY - RESPONSE_FINAL_HEADERS_CAPACITY) {
+        response->headers_overflow = 1;
+        return;
+    }
+
+    memcpy(response->headers + response->headers_length, lines, lines_length);
+    response->headers_length += lines_length;
+}
+
+/**
+ * Appends a segment to the body. Nothing is copied: body must stay valid until the response is sent.
+ *
+ * @return      0 on success, -1 if the response already has HTTP_RESPONSE_MAX_BODY_SEGMENTS segments.
+ */
+int web_response_body(HttpResponse *response, const char *body, size_t body_length) {
+    if (body_length == 0) {
+        return 0;
+    }
+
+    if (response->body_segments_count == HTTP_RESPONSE_MAX_BODY_SEGMENTS) {
+        fprintf(stderr, "Too many body segments in response\nError code: %d\n", errno);
+        return -1;
+    }
+
+    response->body[response->body_segments_count].iov_base = (void *)body;
+    response->body[response->body_segments_count].iov_len = body_length;
+    response->body_segments_count++;
+    response->body_length += body_length;
+
+    return 0;
+}
+
+/**
+ * Makes a range of a file the body of the response, sent with sendfile after the headers. A
+ * response has either a file or memory segments as its body, not both.
+ *
+ * @param       file_fd Left open.
+ */
+void web_response_file(HttpResponse *response, int file_fd, off_t offset, size_t length) {
+    response->file_fd = file_fd;
+    response->file_offset = offset;
+    response->body_length = length;
+}
+
+/**
+ * For pages rendered per request: gives the response a weak ETag hashed from its body, and turns it
+ * into a 304 without a body if the client already holds that version (If-None-Match). The body
+ * must be complete when this is called. A 304 keeps the headers added so far (Vary in particular,
+ * caches need it to pick the right variant) except the ones describing the body.
+ */
+void web_response_revalidate(HttpResponse *response, HttpRequest *request) {
+    unsigned long hash = 0xcbf29ce484222325UL;
+
+    unsigned short i;
+    for (i = 0; i < response->body_segments_count; i++) {
+        hash ^= hash_fnv1a(response->body[i].iov_base, response->body[i].iov_len);
+        hash *= 0x100000001b3UL;
+    }
+
+    char etag[32];
+    size_t etag_length = sprintf(etag, "W/\"%016lx\"", hash);
+
+    const StringView *if_none_match = web_utils_known_header(request, HTTP_HEADER_IF_NONE_MATCH);
+    if (if_none_match != NULL && web_utils_etag_matches(*if_none_match, etag, etag_length)) {
+        web_response_remove_header(response, "Content-Type");
+        web_response_remove_header(response, "Content-Length");
+        web_response_set_status(response, 304);
+        response->body_segments_count = 0;
+        response->body_length = 0;
+    }
+
+    web_response_header(response, "ETag", etag);
+}
+
+/**
+ * Replaces the status line, the headers already added stay as they are.
+ */
+void web_response_set_status(HttpResponse *response, unsigned short status) {
+    char status_line[64];
+    size_t status_line_length = sprintf(status_line, "HTTP/1.1 %u %s\r\n", status, web_response_reason_phrase(status));
+
+    size_t previous_length = (const char *)memchr(response->headers, '\n', response->headers_length) + 1 - response->headers;
+    size_t headers_length = response->headers_length - previous_length + status_line_length;
+
+    if (headers_length > HTTP_RESPONSE_HEADERS_CAPACITY - RESPONSE_FINAL_HEADERS_CAPACITY) {
+        response->headers_overflow = 1;
+        return;
+    }
+
+    memmove(response->headers + status_line_length, response->headers + previous_length, response->headers_length - previous_length);
+    memcpy(response->headers, status_line, status_line_length);
+
+    response->headers_length = headers_length;
+    response->status = status;
+}
+
+/**
+ * Removes every line of the header name added so far, matched without case sensitivity.
+ */
+void web_response_remove_header(HttpResponse *response, const char *name) {
+    size_t name_length = strlen(name);
+
+    /** Header lines start after the status line */
+    char *line = (char *)memchr(response->headers, '\n', response->headers_length) + 1;
+    char *headers_end = response->headers + response->headers_length;
+
+    while (line < headers_end) {
+        char *line_end = (char *)memchr(line, '\n', headers_end - line) + 1;
+
+        if ((size_t)(line_end - line) > name_length && line[name_length] == ':' && strncasecmp(line, name, name_length) == 0) {
+            memmove(line, line_end, headers_end - line_end);
+            headers_end -= line_end - line;
+            continue;
+        }
+
+        line = line_end;
+    }
+
+    response->headers_length = headers_end - response->headers;
+}
+
+/**
+ * Adds Content-Length, Date and Connection, and sends the headers and every body segment in a
+ * single gathered send, retrying on partial writes.
+ */
+int web_response_send(HttpResponse *response) {
+    if (response->headers_overflow) {
+        fprintf(stderr, "Response headers don't fit in HttpResponse.headers\nError code: %d\n", errno);
+        return -1;
+    }
+
+    char *headers_end = response->headers + response->headers_length;
+
+    /** A 304 stands for a response whose length isn't the one of its (empty) body */
+    if (response->status == 304) {
+        response->headers_length += web_response_final_headers(headers_end, response->client_socket);
+    } else {
+        response->headers_length += web_response_framing_headers(headers_end, response->client_socket, response->body_length);
+    }
+
+    struct iovec iov[HTTP_RESPONSE_MAX_BODY_SEGMENTS + 1];
+    iov[0].iov_base = response->headers;
+    iov[0].iov_len = response->headers_length;
+
+    if (response->headers_only) {
+        if (web_utils_send_all(response->client_socket, iov, 1, 0) == -1) {
+            fprintf(stderr, "Failed to send HTTP response\nError code: %d\n", errno);
+            return -1;
+        }
+
+        return 0;
+    }
+
+    unsigned short i;
+    for (i = 0; i < response->body_segments_count; i++) {
+        iov[i + 1] = response->body[i];
+    }
+
+    /** MSG_MORE holds the headers back so they leave in the same segment as the start of the file */
+    int flags = response->file_fd != -1 && response->body_length > 0 ? MSG_MORE : 0;
+
+    if (web_utils_send_all(response->client_socket, iov, response->body_segments_count + 1, flags) == -1) {
+        fprintf(stderr, "Failed to send HTTP response\nError code: %d\n", errno);
+        return -1;
+    }
+
+    if (response->file_fd != -1) {
+        return web_utils_send_file_range(response->client_socket, response->file_fd, response->file_offset, response->body_length);
+    }
+
+    return 0;
+}
+
+/**
+ * Sends a response made of a status line only, for errors that don't need a body.
+ */
+int web_response_send_status(int client_socket, unsigned short status) {
+    HttpResponse response;
+    web_response_init(&response, client_socket, NULL, status);
+
+    return web_response_send(&response);
+}
+
+/**
+ * Tells whether the body can be streamed as it is produced, instead of being sent once complete.
+ * A streamed body goes through web_response_stream_write, the first call sends the headers with
+ * Transfer-Encoding: chunked, and web_response_stream_end sends what is left. A body that ends up
+ * smaller than the threshold never reaches web_response_stream_write: it is sent whole by
+ * web_response_stream_end, with a Content-Length and an ETag.
+ *
+ * Usage:
+ *      size_t flush_threshold = web_response_stream(&response, request);
+ *      if (flush_threshold > 0) {
+ *          te_output_stream(output, flush_threshold, &web_response_stream_write, &response);
+ *      }
+ *      ... render ...
+ *      if (web_response_stream_end(&response, request, output->data, output->length) == -1) { ... }
+ *
+ * @return      How many bytes of the body to gather before sending them, RENDER_FLUSH_THRESHOLD.
+ *              0 if the body has to be sent in one piece: streaming is disabled, the client
+ *              speaks HTTP/1.0 which has no chunked encoding, or the request is a HEAD whose
+ *              response must carry the Content-Length of the whole body.
+ */
+size_t web_response_stream(HttpResponse *response, HttpRequest *request) {
+    Connection *conn = server_connection_get(response->client_socket);
+    if (conn == NULL || request->http_version < HTTP_VERSION_1_1 || request->method == HTTP_METHOD_HEAD) {
+        return 0;
+    }
+
+    return conn->settings->render_flush_threshold;
+}
+
+/**
+ * Sends a piece of a streamed body as a chunk, see web_response_stream. Once the client falls behind,
+ * it waits for the previous chunk to be read before queuing this one, so no more than a chunk is
+ * ever held in memory for a slow client.
+ *
+ * @param       response The HttpResponse, void so it can be given to te_output_stream.
+ */
+int web_response_stream_write(void *response, const char *data, size_t length) {
+    return web_response_send_chunk((HttpResponse *)response, data, length, 0);
+}
+
+/**
+ * Sends the end of a streamed body, or the whole body if nothing was streamed yet.
+ */
+int web_response_stream_end(HttpResponse *response, HttpRequest *request, const char *data, size_t length) {
+    if (!response->chunked) {
+        if (web_response_body(response, data, length) == -1) {
+            fprintf(stderr, "Response body doesn't fit in HttpResponse.body\nError code: %d\n", errno);
+            return -1;
+        }
+
+        web_response_revalidate(response, request);
+
+        return web_response_send(response);
+    }
+
+    return web_response_send_chunk(response, data, length, 1);
+}
+
+/**
+ * @param       last Also sends the zero-length chunk that ends the body.
+ */
+int web_response_send_chunk(HttpResponse *response, const char *data, size_t length, unsigned short last) {
+    Connection *conn = server_connection_get(response->client_socket);
+    if (conn == NULL || conn->fd == -1) {
+        fprintf(stderr, "No connection for client socket fd %d\nError code: %d\n", response->client_socket, errno);
+        return -1;
+    }
+
+    struct iovec iov[5];
+    int iovcnt = 0;
+
+    if (!response->chunked) {
+        web_response_header_lines(response, "Transfer-Encoding: chunked\r\n", 28);
+        if (response->headers_overflow) {
+            fprintf(stderr, "Response headers don't fit in HttpResponse.headers\nError code: %d\n", errno);
+            return -1;
+        }
+
+        response->headers_length += web_response_final_headers(response->headers + response->headers_length, response->client_socket);
+        response->chunked = 1;
+
+        iov[iovcnt].iov_base = response->headers;
+        iov[iovcnt].iov_len = response->headers_length;
+        iovcnt++;
+    } else if (conn->output_head != NULL && server_connection_drain(conn) == -1) {
+        return -1;
+    }
+
+    char size_line[24];
+
+    if (length > 0) {
+        iov[iovcnt].iov_base = size_line;
+        iov[iovcnt].iov_len = sprintf(size_line, "%lx\r\n", (unsigned long)length);
+        iovcnt++;
+
+        iov[iovcnt].iov_base = (void *)data;
+        iov[iovcnt].iov_len = length;
+        iovcnt++;
+
+        iov[iovcnt].iov_base = "\r\n";
+        iov[iovcnt].iov_len = 2;
+        iovcnt++;
+    }
+
+    if (last) {
+        iov[iovcnt].iov_base = "0\r\n\r\n";
+        iov[iovcnt].iov_len = 5;
+        iovcnt++;
+    }
+
+    if (iovcnt > 0 && web_utils_send_all(response->client_socket, iov, iovcnt, 0) == -1) {
+        fprintf(stderr, "Failed to send HTTP response chunk\nError code: %d\n", errno);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Writes the headers that tell the client where the response ends, followed by
+ * web_response_final_headers.
+ *
+ * @param[out]  buffer At least RESPONSE_FINAL_HEADERS_CAPACITY bytes.
+ * @return      The length written.
+ */
+size_t web_response_framing_headers(char *buffer, int client_socket, size_t body_length) {
+    size_t length = sprintf(buffer, "Content-Length: %lu\r\n", (unsigned long)body_length);
+
+    return length + web_response_final_headers(buffer + length, client_socket);
+}
+
+/**
+ * Writes the headers every response ends with: Date, Connection (and Keep-Alive for persistent
+ * connections), and the blank line that ends the headers block.
+ *
+ * @param[out]  buffer At least 96 bytes.
+ * @return      The length written.
+ */
+size_t web_response_final_headers(char *buffer, int client_socket) {
+    memcpy(buffer, web_response_date_header(), RESPONSE_DATE_HEADER_LENGTH);
+    char *position = buffer + RESPONSE_DATE_HEADER_LENGTH;
+
+    Connection *conn = server_connection_get(client_socket);
+
+    if (conn != NULL && conn->keep_alive) {
+        position += sprintf(position, "Connection: keep-alive\r\nKeep-Alive: timeout=%u\r\n\r\n", conn->settings->keep_alive_timeout);
+    } else {
+        position += sprintf(position, "Connection: close\r\n\r\n");
+    }
+
+    return position - buffer;
+}
+
+/**
+ * @return      The Date header line for the current second, "\r\n" included. The copy belongs to
+ *              the calling thread and stays valid until it asks again.
+ */
+const char *web_response_date_header(void) {
+    time_t now = time(NULL);
+
+    if (now != response_date_second) {
+        struct tm now_tm;
+        strftime(response_date_header, sizeof response_date_header, "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", gmtime_r(&now, &now_tm));
+
+        response_date_second = now;
+    }
+
+    return response_date_header;
+}
+
+const char *web_response_reason_phrase(unsigned short status) {
+    switch (status) {
+    case 200:
+        return "OK";
+    case 204:
+        return "No Content";
+    case 206:
+        return "Partial Content";
+    case 301:
+        return "Moved Permanently";
+    case 302:
+        return "Found";
+    case 303:
+        return "See Other";
+    case 304:
+        return "Not Modified";
+    case 400:
+        return "Bad Request";
+    case 403:
+        return "Forbidden";
+    case 404:
+        return "Not Found";
+    case 405:
+        return "Method Not Allowed";
+    case 408:
+        return "Request Timeout";
+    case 413:
+        return "Content Too Large";
+    case 416:
+        return "Range Not Satisfiable";
+    case 431:
+        return "Request Header Fields Too Large";
+    case 500:
+        return "Internal Server Error";
+    case 503:
+        return "Service Unavailable";
+    default:
+        return "Unknown";
+    }
+}
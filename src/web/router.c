@@ -0,0 +1,308 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "web/web.h"
+
+/**
+ * Routes are kept in a trie with one level per path segment, built once at startup from
+ * web_routes. Dispatching walks the segments of the url once: the cost depends on how deep the url
+ * is, not on how many routes there are. A segment is either:
+ *      - literal:   "/sign-up" only matches "sign-up".
+ *      - parameter: "/patients/:id" matches any one segment, captured in request->route_params.
+ *      - wildcard:  a "*" segment, last in the route, matches whatever is left of the url.
+ * Literal segments win over parameters, and parameters over wildcards.
+ *
+ * HEAD is served by the GET handler of a route that has no HEAD handler of its own. The response is
+ * built the same, only its body is left out when it is sent (see HttpResponse.headers_only).
+ */
+
+#define ROUTE_SEGMENT_LITERAL 0
+#define ROUTE_SEGMENT_PARAMETER 1
+#define ROUTE_SEGMENT_WILDCARD 2
+
+#define HTTP_METHODS_COUNT 8
+
+typedef struct RouteNode {
+    unsigned short kind; /** One of ROUTE_SEGMENT_* */
+    StringView segment; /** Literal segments only, points into the path in web_routes */
+    struct RouteNode **children; /** Literal children */
+    unsigned short children_count;
+    struct RouteNode *parameter_child;
+    struct RouteNode *wildcard_child;
+    WebHandler handlers[HTTP_METHODS_COUNT]; /** Indexed by HTTP_METHOD_*, NULL where the method isn't allowed */
+    char allow_header[96]; /** "Allow: GET, POST\r\n", sent along with 405 responses */
+} RouteNode;
+
+typedef struct {
+    unsigned short method;
+    const char *path;
+    WebHandler handler;
+} WebRoute;
+
+/** Every endpoint of the application */
+WebRoute web_routes[] = {{HTTP_METHOD_GET, "/", &web_home_get},
+                         {HTTP_METHOD_GET, "/home", &web_public_route_get},
+                         {HTTP_METHOD_GET, "/about", &web_public_route_get},
+                         {HTTP_METHOD_GET, "/sign-up", &web_sign_up_get},
+                         {HTTP_METHOD_POST, "/sign-up/create-user", &web_sign_up_create_user_post},
+                         {HTTP_METHOD_GET, "/ui-test", &web_ui_test_get},
+                         {HTTP_METHOD_GET, "/src/web/static/*", &web_static_file_get},
+                         {HTTP_METHOD_GET, "/src/web/pages/*", &web_static_file_get},
+                         {HTTP_METHOD_UNKNOWN, NULL, NULL}};
+
+/** Indexed by HTTP_METHOD_* */
+const char *web_router_method_names[HTTP_METHODS_COUNT] = {NULL, "GET", "HEAD", "POST", "PUT", "DELETE", "PATCH", "OPTIONS"};
+
+RouteNode *web_router_root = NULL;
+
+RouteNode *web_router_node_create(unsigned short kind, const char *segment, size_t segment_length);
+void web_router_node_free(RouteNode *node);
+int web_router_add(unsigned short method, const char *path, WebHandler handler);
+RouteNode *web_router_match(RouteNode *node, const char *path, const char *path_end, HttpRequest *request);
+
+/**
+ * Builds the route trie from web_routes. Must be called before any request is dispatched.
+ */
+int web_router_init(void) {
+    web_router_root = web_router_node_create(ROUTE_SEGMENT_LITERAL, "", 0);
+    if (web_router_root == NULL) {
+        return -1;
+    }
+
+    unsigned short i;
+    for (i = 0; web_routes[i].path != NULL; i++) {
+        if (web_router_add(web_routes[i].method, web_routes[i].path, web_routes[i].handler) == -1) {
+            fprintf(stderr, "Failed to add route %s %s\nError code: %d\n", web_router_method_names[web_routes[i].method], web_routes[i].path, errno);
+            web_router_free();
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void web_router_free(void) {
+    web_router_node_free(web_router_root);
+    web_router_root = NULL;
+}
+
+/**
+ * Calls the handler registered for the method and url of the request. Urls without a route get a
+ * 404, and urls with a route but not for this method a 405 that lists the methods they accept.
+ *
+ * @return      Whatever the handler returns, 0 or -1.
+ */
+int web_router_dispatch(int client_socket, HttpRequest *request) {
+    request->route_params_count = 0;
+
+    RouteNode *node = web_router_match(web_router_root, request->url.start, request->url.start + request->url.length, request);
+    if (node == NULL) {
+        return web_not_found(client_socket, request);
+    }
+
+    WebHandler handler = node->handlers[request->method];
+    if (handler == NULL && request->method == HTTP_METHOD_HEAD) {
+        handler = node->handlers[HTTP_METHOD_GET];
+    }
+
+    if (handler == NULL) {
+        return web_method_not_allowed(client_socket, request, node->allow_header);
+    }
+
+    return handler(client_socket, request);
+}
+
+/**
+ * Walks down the trie matching the segments of path, trying literal children first, then the
+ * parameter and then the wildcard child, and backtracking when a branch leads nowhere.
+ *
+ * @param       path The rest of the url, starting at the '/' before the next segment.
+ * @return      The node of the matched route, NULL if no route matches. A node counts as a route
+ *              once a handler was registered on it for any method.
+ */
+RouteNode *web_router_match(RouteNode *node, const char *path, const char *path_end, HttpRequest *request) {
+    if (path == path_end || (path_end - path == 1 && node == web_router_root)) {
+        return node->allow_header[0] != '\0' ? node : NULL;
+    }
+
+    const char *segment = path + 1; /* Skip '/' */
+    const char *segment_end = memchr(segment, '/', path_end - segment);
+    if (segment_end == NULL) {
+        segment_end = path_end;
+    }
+
+    size_t segment_length = segment_end - segment;
+    if (segment_length == 0) {
+        return NULL;
+    }
+
+    unsigned short i;
+    for (i = 0; i < node->children_count; i++) {
+        RouteNode *child = node->children[i];
+        if (child->segment.length == segment_length && memcmp(child->segment.start, segment, segment_length) == 0) {
+            RouteNode *match = web_router_match(child, segment_end, path_end, request);
+            if (match != NULL) {
+                return match;
+            }
+
+            break;
+        }
+    }
+
+    if (node->parameter_child != NULL && request->route_params_count < ROUTE_MAX_PARAMS) {
+        unsigned short param_index = request->route_params_count++;
+        request->route_params[param_index].start = segment;
+        request->route_params[param_index].length = segment_length;
+
+        RouteNode *match = web_router_match(node->parameter_child, segment_end, path_end, request);
+        if (match != NULL) {
+            return match;
+        }
+
+        request->route_params_count--;
+    }
+
+    if (node->wildcard_child != NULL && node->wildcard_child->allow_header[0] != '\0' && request->route_params_count < ROUTE_MAX_PARAMS) {
+        /** The wildcard captures the rest of the url, without the leading '/' */
+        request->route_params[request->route_params_count].start = segment;
+        request->route_params[request->route_params_count].length = path_end - segment;
+        request->route_params_count++;
+
+        return node->wildcard_child;
+    }
+
+    return NULL;
+}
+
+/**
+ * @param       path Absolute path, made of '/' separated segments. A segment can be ":name" to
+ *              match any segment, or "*" (last segment only) to match the rest of the url.
+ */
+int web_router_add(unsigned short method, const char *path, WebHandler handler) {
+    if (path[0] != '/' || method == HTTP_METHOD_UNKNOWN || method >= HTTP_METHODS_COUNT) {
+        fprintf(stderr, "Invalid route\nError code: %d\n", errno);
+        return -1;
+    }
+
+    RouteNode *node = web_router_root;
+    const char *segment = path + 1; /* Skip '/' */
+
+    while (*segment != '\0') {
+        const char *segment_end = strchr(segment, '/');
+        if (segment_end == NULL) {
+            segment_end = segment + strlen(segment);
+        }
+
+        size_t segment_length = segment_end - segment;
+        if (segment_length == 0) {
+            fprintf(stderr, "Empty segment in route\nError code: %d\n", errno);
+            return -1;
+        }
+
+        if (segment[0] == '*') {
+            if (*segment_end != '\0') {
+                fprintf(stderr, "A wildcard must be the last segment of a route\nError code: %d\n", errno);
+                return -1;
+            }
+
+            if (node->wildcard_child == NULL && (node->wildcard_child = web_router_node_create(ROUTE_SEGMENT_WILDCARD, NULL, 0)) == NULL) {
+                return -1;
+            }
+
+            node = node->wildcard_child;
+        } else if (segment[0] == ':') {
+            if (node->parameter_child == NULL && (node->parameter_child = web_router_node_create(ROUTE_SEGMENT_PARAMETER, NULL, 0)) == NULL) {
+                return -1;
+            }
+
+            node = node->parameter_child;
+        } else {
+            RouteNode *child = NULL;
+
+            unsigned short i;
+            for (i = 0; i < node->children_count; i++) {
+                if (node->children[i]->segment.length == segment_length && memcmp(node->children[i]->segment.start, segment, segment_length) == 0) {
+                    child = node->children[i];
+                    break;
+                }
+            }
+
+            if (child == NULL) {
+                RouteNode **children = (RouteNode **)realloc(node->children, (node->children_count + 1) * sizeof(RouteNode *));
+                if (children == NULL) {
+                    fprintf(stderr, "Failed to reallocate memory for node->children\nError code: %d\n", errno);
+                    return -1;
+                }
+
+                node->children = children;
+
+                child = web_router_node_create(ROUTE_SEGMENT_LITERAL, segment, segment_length);
+                if (child == NULL) {
+                    return -1;
+                }
+
+                node->children[node->children_count++] = child;
+            }
+
+            node = child;
+        }
+
+        segment = *segment_end == '/' ? segment_end + 1 : segment_end;
+    }
+
+    if (node->handlers[method] != NULL) {
+        fprintf(stderr, "Route registered twice\nError code: %d\n", errno);
+        return -1;
+    }
+
+    node->handlers[method] = handler;
+
+    /** Rebuild the Allow header so it lists every method of the route in a stable order, HEAD along with GET */
+    size_t allow_length = sprintf(node->allow_header, "Allow:");
+
+    unsigned short i;
+    for (i = 0; i < HTTP_METHODS_COUNT; i++) {
+        if (node->handlers[i] != NULL || (i == HTTP_METHOD_HEAD && node->handlers[HTTP_METHOD_GET] != NULL)) {
+            allow_length += sprintf(node->allow_header + allow_length, "%s %s", allow_length > 6 ? "," : "", web_router_method_names[i]);
+        }
+    }
+
+    sprintf(node->allow_header + allow_length, "\r\n");
+
+    return 0;
+}
+
+RouteNode *web_router_node_create(unsigned short kind, const char *segment, size_t segment_length) {
+    RouteNode *node = (RouteNode *)calloc(1, sizeof(RouteNode));
+    if (node == NULL) {
+        fprintf(stderr, "Failed to allocate memory for node\nError code: %d\n", errno);
+        return NULL;
+    }
+
+    node->kind = kind;
+    node->segment.start = segment;
+    node->segment.length = segment_length;
+
+    return node;
+}
+
+void web_router_node_free(RouteNode *node) {
+    if (node == NULL) {
+        return;
+    }
+
+    unsigned short i;
+    for (i = 0; i < node->children_count; i++) {
+        web_router_node_free(node->children[i]);
+    }
+
+    free(node->children);
+    node->children = NULL;
+
+    web_router_node_free(node->parameter_child);
+    web_router_node_free(node->wildcard_child);
+
+    free(node);
+}
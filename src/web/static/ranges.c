@@ -0,0 +1,280 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "utils/utils.h"
+#include "web/web.h"
+
+/**
+ * Byte range requests (Range and If-Range), so downloads of large files can be resumed or fetched
+ * in parallel pieces. A single range is answered with a plain 206, several ranges with a
+ * multipart/byteranges body. Files sent from disk go out with sendfile at the offset of each range.
+ */
+
+/** The longest part header: "\r\n--" boundary "\r\nContent-Type: " type "\r\nContent-Range: bytes a-b/size\r\n\r\n" */
+#define RANGES_PART_HEADERS_CAPACITY 192
+
+size_t web_static_parse_range_number(const char **position, const char *end, size_t *number);
+
+/**
+ * Resolves the Range header of request against a file of the given size. The header is ignored
+ * for any method but GET, when If-Range names another version of the file than the one identified
+ * by etag and last_modified, when it is malformed, or when it asks for more than HTTP_MAX_RANGES
+ * ranges. A HEAD gets the headers of the whole file.
+ *
+ * @param       etag Strong entity tag of the file, quoted.
+ * @param[out]  ranges At least HTTP_MAX_RANGES entries, in the order they were asked for.
+ * @return      The amount of satisfiable ranges, 0 if the whole file must be sent instead, -1 if
+ *              none of the ranges asked for is satisfiable.
+ */
+int web_static_parse_ranges(HttpRequest *request, const char *etag, size_t etag_length, time_t last_modified, size_t size, ByteRange *ranges) {
+    const StringView *range = web_utils_known_header(request, HTTP_HEADER_RANGE);
+    if (range == NULL || request->method != HTTP_METHOD_GET) {
+        return 0;
+    }
+
+    const StringView *if_range = web_utils_known_header(request, HTTP_HEADER_IF_RANGE);
+    if (if_range != NULL) {
+        /** If-Range holds either an entity tag, compared strongly, or a date */
+        if (if_range->length > 0 && (if_range->start[0] == '"' || if_range->start[0] == 'W')) {
+            if (if_range->length != etag_length || memcmp(if_range->start, etag, etag_length) != 0) {
+                return 0;
+            }
+        } else {
+            time_t if_range_date;
+            if (web_utils_parse_http_date(*if_range, &if_range_date) == -1 || if_range_date != last_modified) {
+                return 0;
+            }
+        }
+    }
+
+    if (range->length < 6 || memcmp(range->start, "bytes=", 6) != 0) {
+        return 0;
+    }
+
+    const char *position = range->start + 6;
+    const char *end = range->start + range->length;
+    int ranges_count = 0;
+    unsigned short specs_count = 0;
+
+    while (position < end) {
+        while (position < end && (*position == ' ' || *position == '\t' || *position == ',')) {
+            position++;
+        }
+
+        if (position == end) {
+            break;
+        }
+
+        if (++specs_count > HTTP_MAX_RANGES) {
+            return 0;
+        }
+
+        size_t first = 0;
+        size_t last = 0;
+        unsigned short has_first = web_static_parse_range_number(&position, end, &first) > 0;
+
+        if (position == end || *position != '-') {
+            return 0;
+        }
+
+        position++;
+
+        unsigned short has_last = web_static_parse_range_number(&position, end, &last) > 0;
+
+        while (position < end && (*position == ' ' || *position == '\t')) {
+            position++;
+        }
+
+        if ((position < end && *position != ',') || (!has_first && !has_last) || (has_first && has_last && last < first)) {
+            return 0;
+        }
+
+        if (!has_first) {
+            /** "-n" is the last n bytes */
+            if (last == 0 || size == 0) {
+                continue;
+            }
+
+            first = last < size ? size - last : 0;
+            last = size - 1;
+        } else {
+            if (first >= size) {
+                continue;
+            }
+
+            if (!has_last || last >= size) {
+                last = size - 1;
+            }
+        }
+
+        ranges[ranges_count].start = first;
+        ranges[ranges_count].length = last - first + 1;
+        ranges_count++;
+    }
+
+    if (specs_count == 0) {
+        return 0;
+    }
+
+    return ranges_count > 0 ? ranges_count : -1;
+}
+
+/**
+ * @return      The amount of digits read, 0 if position isn't on a digit or the number overflows.
+ */
+size_t web_static_parse_range_number(const char **position, const char *end, size_t *number) {
+    size_t digits = 0;
+    *number = 0;
+
+    while (*position < end && **position >= '0' && **position <= '9') {
+        if (*number > ((size_t)-1 - 9) / 10) {
+            return 0;
+        }
+
+        *number = *number * 10 + (**position - '0');
+        (*position)++;
+        digits++;
+    }
+
+    return digits;
+}
+
+/**
+ * Sends a 206 Partial Content with the given ranges of a file, taken from body when the file is in
+ * memory, or straight from file_fd with sendfile otherwise.
+ *
+ * @param       request A HEAD only gets the headers. Ranges are ignored for HEAD (see
+ *              web_static_parse_ranges), this keeps the body out should that ever change.
+ * @param       validators Header lines of the full response to repeat (ETag, Last-Modified...).
+ * @param       body NULL to send from file_fd.
+ */
+int web_static_send_ranges(int client_socket, const HttpRequest *request, const char *content_type, const char *validators, size_t size, const ByteRange *ranges, unsigned short ranges_count, const char *body, int file_fd) {
+    char headers[512];
+    size_t headers_length;
+
+    char part_headers[HTTP_MAX_RANGES][RANGES_PART_HEADERS_CAPACITY];
+    size_t part_headers_lengths[HTTP_MAX_RANGES];
+    char closing_boundary[48];
+    size_t closing_boundary_length = 0;
+    size_t content_length = 0;
+
+    unsigned short i;
+
+    if (ranges_count == 1) {
+        content_length = ranges[0].length;
+        headers_length = sprintf(headers, "HTTP/1.1 206 Partial Content\r\nContent-Type: %s\r\nContent-Range: bytes %lu-%lu/%lu\r\n%s", content_type, (unsigned long)ranges[0].start,
+                                 (unsigned long)(ranges[0].start + ranges[0].length - 1), (unsigned long)size, validators);
+    } else {
+        /** Derived from the validators, the same version of a file always gets the same boundary */
+        char boundary[24];
+        sprintf(boundary, "%016lx", hash_fnv1a(validators, strlen(validators)) ^ 0x5bd1e9955bd1e995UL);
+
+        for (i = 0; i < ranges_count; i++) {
+            part_headers_lengths[i] = sprintf(part_headers[i], "\r\n--%s\r\nContent-Type: %s\r\nContent-Range: bytes %lu-%lu/%lu\r\n\r\n", boundary, content_type, (unsigned long)ranges[i].start,
+                                              (unsigned long)(ranges[i].start + ranges[i].length - 1), (unsigned long)size);
+            content_length += part_headers_lengths[i] + ranges[i].length;
+        }
+
+        closing_boundary_length = sprintf(closing_boundary, "\r\n--%s--\r\n", boundary);
+        content_length += closing_boundary_length;
+
+        headers_length = sprintf(headers, "HTTP/1.1 206 Partial Content\r\nContent-Type: multipart/byteranges; boundary=%s\r\n%s", boundary, validators);
+    }
+
+    headers_length += web_response_framing_headers(headers + headers_length, client_socket, content_length);
+
+    if (request->method == HTTP_METHOD_HEAD) {
+        struct iovec iov;
+        iov.iov_base = headers;
+        iov.iov_len = headers_length;
+
+        if (web_utils_send_all(client_socket, &iov, 1, 0) == -1) {
+            fprintf(stderr, "Failed to send ranges headers\nError code: %d\n", errno);
+            return -1;
+        }
+
+        return 0;
+    }
+
+    /** From memory the whole response is a single gathered send */
+    if (body != NULL) {
+        struct iovec iov[2 + 2 * HTTP_MAX_RANGES];
+        int iovcnt = 0;
+
+        iov[iovcnt].iov_base = headers;
+        iov[iovcnt++].iov_len = headers_length;
+
+        for (i = 0; i < ranges_count; i++) {
+            if (ranges_count > 1) {
+                iov[iovcnt].iov_base = part_headers[i];
+                iov[iovcnt++].iov_len = part_headers_lengths[i];
+            }
+
+            iov[iovcnt].iov_base = (void *)(body + ranges[i].start);
+            iov[iovcnt++].iov_len = ranges[i].length;
+        }
+
+        if (ranges_count > 1) {
+            iov[iovcnt].iov_base = closing_boundary;
+            iov[iovcnt++].iov_len = closing_boundary_length;
+        }
+
+        if (web_utils_send_all(client_socket, iov, iovcnt, 0) == -1) {
+            fprintf(stderr, "Failed to send ranges\nError code: %d\n", errno);
+            return -1;
+        }
+
+        return 0;
+    }
+
+    struct iovec iov;
+    iov.iov_base = headers;
+    iov.iov_len = headers_length;
+
+    if (web_utils_send_all(client_socket, &iov, 1, MSG_MORE) == -1) {
+        fprintf(stderr, "Failed to send ranges headers\nError code: %d\n", errno);
+        return -1;
+    }
+
+    for (i = 0; i < ranges_count; i++) {
+        if (ranges_count > 1) {
+            iov.iov_base = part_headers[i];
+            iov.iov_len = part_headers_lengths[i];
+
+            if (web_utils_send_all(client_socket, &iov, 1, MSG_MORE) == -1) {
+                fprintf(stderr, "Failed to send range headers\nError code: %d\n", errno);
+                return -1;
+            }
+        }
+
+        if (web_utils_send_file_range(client_socket, file_fd, ranges[i].start, ranges[i].length) == -1) {
+            return -1;
+        }
+    }
+
+    if (ranges_count > 1) {
+        iov.iov_base = closing_boundary;
+        iov.iov_len = closing_boundary_length;
+
+        if (web_utils_send_all(client_socket, &iov, 1, 0) == -1) {
+            fprintf(stderr, "Failed to send closing boundary\nError code: %d\n", errno);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int web_static_send_range_not_satisfiable(int client_socket, const HttpRequest *request, size_t size) {
+    char content_range[32];
+    sprintf(content_range, "bytes */%lu", (unsigned long)size);
+
+    HttpResponse http_response;
+    web_response_init(&http_response, client_socket, request, 416);
+    web_response_header(&http_response, "Content-Range", content_range);
+
+    return web_response_send(&http_response);
+}
@@ -1,82 +1,131 @@
 #include <errno.h>
+#include <fcntl.h>
 #include <linux/limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
-#include "globals.h"
-#include "utils/utils.h"
+#include "web/web.h"
+
+/**
+ * Sends a file from the project folder as the body of the response. The file is opened once, sized
+ * with fstat, and its content goes from the page cache to the socket with sendfile, without being
+ * copied into this process. Files that don't exist get a 404.
+ *
+ * The file is identified by its modification time and size, which make up its ETag, so conditional
+ * and range requests are answered without reading it.
+ *
+ * @param       path Path relative to the project root, which is the working directory. A leading
+ *              slash is ignored, so urls can be passed as they are.
+ */
+int web_static(int client_socket, HttpRequest *request, char *path, const char *content_type) {
+    int retval = 0;
+
+    if (path[0] == '/') {
+        path++;
+    }
+
+    int file_fd = open(path, O_RDONLY);
+    if (file_fd == -1) {
+        if (errno == ENOENT || errno == ENOTDIR || errno == EACCES) {
+            return web_not_found(client_socket, request);
+        }
 
-int web_static(int client_socket, char *path, const char *response_headers, size_t response_headers_length) {
-    char *file_absolute_path;
-    file_absolute_path = (char *)malloc(PATH_MAX * (sizeof *file_absolute_path) + 1);
-    if (file_absolute_path == NULL) {
-        fprintf(stderr, "Failed to allocate memory for file_absolute_path\nError code: %d\n", errno);
+        fprintf(stderr, "Failed to open file %s\nError code: %d\n", path, errno);
         return -1;
     }
 
-    file_absolute_path[0] = '\0';
-
-    /** Remove the leading slash if path is NOT the root url (home page) */
-    if (strcmp(path, "/") != 0) {
-        path++;
+    struct stat file_stat;
+    if (fstat(file_fd, &file_stat) == -1) {
+        fprintf(stderr, "Failed to get status of file %s\nError code: %d\n", path, errno);
+        retval = -1;
+        goto cleanup;
     }
 
-    if (build_absolute_path(file_absolute_path, path) == -1) {
-        return -1;
+    if (!S_ISREG(file_stat.st_mode)) {
+        retval = web_not_found(client_socket, request);
+        goto cleanup;
     }
 
-    ssize_t file_size = calculate_file_size(file_absolute_path);
-    if (file_size == -1) {
-        free(file_absolute_path);
-        file_absolute_path = NULL;
-        return -1;
+    size_t file_size = file_stat.st_size;
+
+    char etag[40];
+    size_t etag_length = sprintf(etag, "\"%lx-%lx\"", (unsigned long)file_stat.st_mtime, (unsigned long)file_size);
+
+    struct tm last_modified_tm;
+    char last_modified[32];
+    strftime(last_modified, sizeof last_modified, "%a, %d %b %Y %H:%M:%S GMT", gmtime_r(&file_stat.st_mtime, &last_modified_tm));
+
+    char validators[96];
+    size_t validators_length = sprintf(validators, "ETag: %s\r\nLast-Modified: %s\r\n", etag, last_modified);
+
+    if (web_static_not_modified(request, etag, etag_length, file_stat.st_mtime)) {
+        HttpResponse not_modified_response;
+        web_response_init(&not_modified_response, client_socket, request, 304);
+        web_response_header_lines(&not_modified_response, validators, validators_length);
+
+        retval = web_response_send(&not_modified_response);
+        goto cleanup;
     }
 
-    char *response;
-    size_t response_length = ((size_t)(file_size)) + response_headers_length;
-    response = (char *)malloc(response_length * (sizeof *response) + 1);
-    if (response == NULL) {
-        fprintf(stderr, "Failed to allocate memory for response\nError code: %d\n", errno);
-        free(file_absolute_path);
-        file_absolute_path = NULL;
-        return -1;
+    ByteRange ranges[HTTP_MAX_RANGES];
+    int ranges_count = web_static_parse_ranges(request, etag, etag_length, file_stat.st_mtime, file_size, ranges);
+
+    if (ranges_count == -1) {
+        retval = web_static_send_range_not_satisfiable(client_socket, request, file_size);
+        goto cleanup;
     }
 
-    response[0] = '\0';
+    if (ranges_count > 0) {
+        retval = web_static_send_ranges(client_socket, request, content_type, validators, file_size, ranges, ranges_count, NULL, file_fd);
+        goto cleanup;
+    }
 
-    /* Add headers to response */
-    strcpy(response, response_headers);
+    HttpResponse http_response;
+    web_response_init(&http_response, client_socket, request, 200);
+    web_response_header(&http_response, "Content-Type", content_type);
+    web_response_header(&http_response, "Accept-Ranges", "bytes");
+    web_response_header_lines(&http_response, validators, validators_length);
+    web_response_file(&http_response, file_fd, 0, file_size);
 
-    /* Add the file contents to the response */
-    if (read_file(response + response_headers_length, file_absolute_path, file_size) == -1) {
-        free(file_absolute_path);
-        file_absolute_path = NULL;
-        free(response);
-        response = NULL;
-        return -1;
+    if (web_response_send(&http_response) == -1) {
+        retval = -1;
     }
 
-    response[response_length] = '\0';
+cleanup:
+    close(file_fd);
 
-    free(file_absolute_path);
-    file_absolute_path = NULL;
+    return retval;
+}
 
-    if (send(client_socket, response, response_length, 0) == -1) {
-        fprintf(stderr, "Failed send HTTP response\nError code: %d\n", errno);
-        free(response);
-        response = NULL;
-        return -1;
+/**
+ * Evaluates the preconditions of a GET: If-None-Match when the request has it, If-Modified-Since
+ * otherwise.
+ *
+ * @param       etag Entity tag of the version of the file that would be sent, quoted.
+ * @return      1 if the client already holds that version, 0 if it must be sent.
+ */
+unsigned int web_static_not_modified(HttpRequest *request, const char *etag, size_t etag_length, time_t last_modified) {
+    const StringView *if_none_match = web_utils_known_header(request, HTTP_HEADER_IF_NONE_MATCH);
+    if (if_none_match != NULL) {
+        return web_utils_etag_matches(*if_none_match, etag, etag_length);
     }
 
-    close(client_socket);
+    const StringView *if_modified_since = web_utils_known_header(request, HTTP_HEADER_IF_MODIFIED_SINCE);
+    if (if_modified_since == NULL) {
+        return 0;
+    }
 
-    free(response);
-    response = NULL;
+    /** Dates in other formats than the one of Last-Modified are ignored, as the spec allows */
+    time_t if_modified_since_date;
+    if (web_utils_parse_http_date(*if_modified_since, &if_modified_since_date) == -1) {
+        return 0;
+    }
 
-    return 0;
+    return last_modified <= if_modified_since_date;
 }
 
 int construct_public_route_file_path(char **path_buffer, char *url) {
@@ -99,15 +148,83 @@ int construct_public_route_file_path(char **path_buffer, char *url) {
     return 0;
 }
 
-unsigned int requested_public_route(const char *url) {
-    char *public_routes[] = {"/home", "/about", NULL};
+/**
+ * Handler of the routes under the asset folders, the url is the path of the file relative to the
+ * project root. Only the file types web_static_content_type knows are served.
+ */
+int web_static_file_get(int client_socket, HttpRequest *request) {
+    StringView url = request->url;
 
-    unsigned short i;
-    for (i = 0; public_routes[i] != NULL; i++) {
-        if (strcmp(url, public_routes[i]) == 0) {
-            return 0;
-        }
+    int cache_status = web_static_cache_send(client_socket, request);
+    if (cache_status != 1) {
+        return cache_status;
+    }
+
+    /** The route only vouches for the folder the url starts with, ".." would climb out of it */
+    if (url.length >= PATH_MAX || memmem(url.start, url.length, "/..", 3) != NULL) {
+        return web_not_found(client_socket, request);
+    }
+
+    const char *content_type = web_static_content_type(url.start, url.length);
+    if (content_type == NULL) {
+        return web_not_found(client_socket, request);
+    }
+
+    /** Files are opened by path, which needs a null-terminated copy of the url */
+    char path[PATH_MAX];
+    memcpy(path, url.start, url.length);
+    path[url.length] = '\0';
+
+    return web_static(client_socket, request, path, content_type);
+}
+
+/**
+ * Handler of the public routes, pages that are served as they are from /src/web/pages/public.
+ */
+int web_public_route_get(int client_socket, HttpRequest *request) {
+    int retval = 0;
+
+    int cache_status = web_static_cache_send(client_socket, request);
+    if (cache_status != 1) {
+        return cache_status;
+    }
+
+    char url[PATH_MAX];
+    if (request->url.length >= sizeof url) {
+        return web_not_found(client_socket, request);
+    }
+
+    memcpy(url, request->url.start, request->url.length);
+    url[request->url.length] = '\0';
+
+    char *public_route = NULL;
+    if (construct_public_route_file_path(&public_route, url) == -1) {
+        return -1;
+    }
+
+    if (web_static(client_socket, request, public_route, "text/html") == -1) {
+        retval = -1;
+    }
+
+    free(public_route);
+    public_route = NULL;
+
+    return retval;
+}
+
+/**
+ * @return 0 if the file path has the specified extension, 1 otherwise.
+ */
+unsigned int has_file_extension(StringView file_path, const char *extension) {
+    size_t extension_length = strlen(extension);
+
+    if (extension_length > file_path.length) {
+        return 1;
+    }
+
+    if (memcmp(file_path.start + file_path.length - extension_length, extension, extension_length) == 0) {
+        return 0;
     }
 
     return 1;
-}
\ No newline at end of file
+}
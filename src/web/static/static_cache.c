@@ -0,0 +1,788 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "globals.h"
+#include "server/server.h"
+#include "utils/utils.h"
+#include "web/web.h"
+
+/**
+ * Every asset (stylesheets, scripts, images, documents) and public page of the project, held in
+ * memory as a complete response: status line, Content-Type, Content-Length, ETag and Last-Modified
+ * followed by the file content. Files over STATIC_CACHE_MAX_FILE_SIZE are left out and sent from
+ * disk. The cache is filled at startup, so serving one of these files doesn't touch the
+ * filesystem, only the socket. Clients revalidating a file they already hold get a 304 without the
+ * content.
+ *
+ * Next to the raw bytes, every file is kept compressed with gzip and with deflate, so clients that
+ * accept either get fewer bytes on the wire without the server compressing anything per request.
+ *
+ * A thread watches the folders with inotify and reloads a file once it is written or moved in
+ * place, or drops it when it is deleted, and starts watching folders created or moved in. Responses
+ * are reference counted: a worker sending a response keeps it alive even if the file is reloaded in
+ * the meantime. On request (SIGHUP), or when inotify lost events, the same thread rescans every
+ * folder.
+ */
+
+#define STATIC_CACHE_CAPACITY 512 /** A power of two, the table is never filled past three quarters */
+#define STATIC_CACHE_MAX_WATCHES 128
+#define STATIC_CACHE_HEADERS_CAPACITY 256
+#define STATIC_CACHE_MAX_FILE_SIZE 1048576 /** Larger files, documents rather than assets, are sent from disk */
+
+/** Content codings a file is kept in, in order of preference */
+#define STATIC_ENCODING_GZIP 0
+#define STATIC_ENCODING_DEFLATE 1
+#define STATIC_ENCODING_IDENTITY 2
+#define STATIC_ENCODINGS_COUNT 3
+
+typedef struct {
+    const char *headers; /** From the status line to the Vary header, without the framing headers */
+    size_t headers_length;
+    const char *validators; /** The ETag, Last-Modified and Vary lines at the end of headers, repeated in a 304 */
+    size_t validators_length;
+    const char *etag; /** Quoted, inside validators */
+    size_t etag_length;
+    const char *body; /** NULL when compressing the file doesn't make it smaller */
+    size_t body_length;
+} StaticVariant;
+
+typedef struct {
+    volatile unsigned int references; /** One held by the cache entry, one per worker sending it */
+    const char *content_type;
+    time_t last_modified;
+    StaticVariant variants[STATIC_ENCODINGS_COUNT]; /** Indexed by STATIC_ENCODING_* */
+} StaticResponse;
+
+/** Indexed by STATIC_ENCODING_*, the token of the coding in Accept-Encoding and Content-Encoding */
+const char *static_cache_encoding_names[STATIC_ENCODINGS_COUNT] = {"gzip", "deflate", "identity"};
+
+/** zlib windowBits giving each compressed STATIC_ENCODING_* format: + 16 wraps the stream as gzip */
+const int static_cache_encoding_window_bits[STATIC_ENCODING_IDENTITY] = {MAX_WBITS + 16, MAX_WBITS};
+
+typedef struct {
+    char *url; /** NULL for empty slots */
+    size_t url_length;
+    StaticResponse *response; /** NULL once the file is deleted */
+    unsigned int generation; /** Of the scan that last loaded the file, see web_static_cache_rescan */
+} StaticCacheEntry;
+
+typedef struct {
+    const char *extension;
+    const char *content_type;
+} StaticContentType;
+
+typedef struct {
+    int watch_descriptor;
+    char *directory;
+    unsigned short public; /** The public pages folder, its .html files are served by name at the root */
+} StaticCacheWatch;
+
+/** Files with any other extension aren't served from the asset folders */
+const StaticContentType static_content_types[] = {{".css", "text/css"},
+                                                  {".js", "application/javascript"},
+                                                  {".pdf", "application/pdf"},
+                                                  {".png", "image/png"},
+                                                  {".jpg", "image/jpeg"},
+                                                  {".jpeg", "image/jpeg"},
+                                                  {".gif", "image/gif"},
+                                                  {".webp", "image/webp"},
+                                                  {".svg", "image/svg+xml"},
+                                                  {".ico", "image/x-icon"},
+                                                  {".txt", "text/plain"}};
+
+StaticCacheEntry static_cache_entries[STATIC_CACHE_CAPACITY];
+unsigned int static_cache_entries_count = 0;
+pthread_mutex_t static_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+StaticCacheWatch static_cache_watches[STATIC_CACHE_MAX_WATCHES];
+unsigned int static_cache_watches_count = 0;
+int static_cache_inotify_fd = -1;
+pthread_t static_cache_watcher;
+unsigned short static_cache_watcher_started = 0;
+unsigned int static_cache_generation = 0;
+volatile unsigned int static_cache_rescan_requested = 0;
+
+int web_static_cache_add_directory(const char *directory, unsigned short public);
+int web_static_cache_url(char *url, const char *file_path, unsigned short public, const char **content_type);
+int web_static_cache_load(const char *file_path, unsigned short public);
+void web_static_cache_keep(const char *file_path, unsigned short public);
+void web_static_cache_remove(const char *file_path, unsigned short public);
+StaticCacheEntry *web_static_cache_find(const char *url, size_t url_length);
+int web_static_cache_compress(StaticVariant *variant, const char *body, size_t body_length, int window_bits);
+void web_static_cache_release(StaticResponse *response);
+void *web_static_cache_watch(void *arg);
+void web_static_cache_rescan(void);
+
+/**
+ * Loads every file served from src/web/static and src/web/pages, and starts watching them for
+ * changes. Must be called before any thread starts handling requests.
+ */
+int web_static_cache_init(void) {
+    static_cache_inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (static_cache_inotify_fd == -1) {
+        fprintf(stderr, "Failed to create inotify instance\nError code: %d\n", errno);
+        return -1;
+    }
+
+    if (web_static_cache_add_directory("src/web/static", 0) == -1 || web_static_cache_add_directory("src/web/pages", 0) == -1) {
+        return -1;
+    }
+
+    if (pthread_create(&static_cache_watcher, NULL, &web_static_cache_watch, NULL) != 0) {
+        fprintf(stderr, "Failed to create static cache watcher thread\nError code: %d\n", errno);
+        return -1;
+    }
+
+    static_cache_watcher_started = 1;
+
+    return 0;
+}
+
+/**
+ * Must only be called once keep_running is 0 (the watcher thread checks it to exit) and no worker
+ * is sending responses anymore.
+ */
+void web_static_cache_free(void) {
+    if (static_cache_watcher_started) {
+        pthread_join(static_cache_watcher, NULL);
+        static_cache_watcher_started = 0;
+    }
+
+    if (static_cache_inotify_fd != -1) {
+        close(static_cache_inotify_fd);
+        static_cache_inotify_fd = -1;
+    }
+
+    unsigned int i;
+    for (i = 0; i < static_cache_watches_count; i++) {
+        free(static_cache_watches[i].directory);
+        static_cache_watches[i].directory = NULL;
+    }
+
+    static_cache_watches_count = 0;
+
+    for (i = 0; i < STATIC_CACHE_CAPACITY; i++) {
+        web_static_cache_release(static_cache_entries[i].response);
+        static_cache_entries[i].response = NULL;
+
+        free(static_cache_entries[i].url);
+        static_cache_entries[i].url = NULL;
+    }
+
+    static_cache_entries_count = 0;
+}
+
+/**
+ * Asks the watcher thread to reload every file, for changes inotify can't report (files edited
+ * while the server was stopped, folders mounted over). Returns right away, the rescan takes up to a
+ * second to start. Responses are replaced one by one: a file is never missing from the cache while it runs.
+ */
+void web_static_cache_reload(void) {
+    static_cache_rescan_requested = 1;
+}
+
+/**
+ * Sends the cached response for the url of request in a single call, in the smallest coding the
+ * client accepts.
+ *
+ * @return      0 if the response was sent, 1 if url isn't cached, -1 if sending failed.
+ */
+int web_static_cache_send(int client_socket, HttpRequest *request) {
+    pthread_mutex_lock(&static_cache_mutex);
+
+    StaticCacheEntry *entry = web_static_cache_find(request->url.start, request->url.length);
+    StaticResponse *response = entry != NULL ? entry->response : NULL;
+    if (response != NULL) {
+        __sync_add_and_fetch(&response->references, 1);
+    }
+
+    pthread_mutex_unlock(&static_cache_mutex);
+
+    if (response == NULL) {
+        return 1;
+    }
+
+    unsigned short encoding;
+    for (encoding = 0; encoding < STATIC_ENCODING_IDENTITY; encoding++) {
+        if (response->variants[encoding].body != NULL && web_utils_accepts_encoding(request, static_cache_encoding_names[encoding])) {
+            break;
+        }
+    }
+
+    StaticVariant *variant = &response->variants[encoding];
+
+    /** Ranges are served out of the uncompressed file */
+    StaticVariant *identity = &response->variants[STATIC_ENCODING_IDENTITY];
+    ByteRange ranges[HTTP_MAX_RANGES];
+    int ranges_count = web_static_parse_ranges(request, identity->etag, identity->etag_length, response->last_modified, identity->body_length, ranges);
+    if (ranges_count != 0) {
+        variant = identity;
+    }
+
+    int retval = 0;
+
+    if (web_static_not_modified(request, variant->etag, variant->etag_length, response->last_modified)) {
+        HttpResponse not_modified_response;
+        web_response_init(&not_modified_response, client_socket, request, 304);
+        web_response_header_lines(&not_modified_response, variant->validators, variant->validators_length);
+
+        retval = web_response_send(&not_modified_response);
+        web_static_cache_release(response);
+        return retval;
+    }
+
+    if (ranges_count != 0) {
+        if (ranges_count == -1) {
+            retval = web_static_send_range_not_satisfiable(client_socket, request, identity->body_length);
+        } else {
+            retval = web_static_send_ranges(client_socket, request, response->content_type, identity->validators, identity->body_length, ranges, ranges_count, identity->body, -1);
+        }
+
+        web_static_cache_release(response);
+        return retval;
+    }
+
+    /** The status line and every header but these few were formatted when the file was loaded */
+    char final_headers[128];
+    size_t final_headers_length = web_response_final_headers(final_headers, client_socket);
+
+    struct iovec iov[3];
+    iov[0].iov_base = (void *)variant->headers;
+    iov[0].iov_len = variant->headers_length;
+    iov[1].iov_base = final_headers;
+    iov[1].iov_len = final_headers_length;
+    iov[2].iov_base = (void *)variant->body;
+    iov[2].iov_len = variant->body_length;
+
+    /** A HEAD gets the same headers, the body they describe is left out */
+    int iovcnt = variant->body_length > 0 && request->method != HTTP_METHOD_HEAD ? 3 : 2;
+
+    if (web_utils_send_all(client_socket, iov, iovcnt, 0) == -1) {
+        fprintf(stderr, "Failed to send cached response\nError code: %d\n", errno);
+        retval = -1;
+    }
+
+    web_static_cache_release(response);
+
+    return retval;
+}
+
+/**
+ * @return      The Content-Type files with this name are served with, NULL for files that aren't
+ *              served from the asset folders.
+ */
+const char *web_static_content_type(const char *file_path, size_t file_path_length) {
+    StringView path;
+    path.start = file_path;
+    path.length = file_path_length;
+
+    unsigned int i;
+    for (i = 0; i < sizeof static_content_types / sizeof static_content_types[0]; i++) {
+        if (has_file_extension(path, static_content_types[i].extension) == 0) {
+            return static_content_types[i].content_type;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Loads the files of directory and of every folder below it, and watches each of them. A file or
+ * folder that fails to load doesn't stop the others from loading, a file keeps its previous version
+ * unless it is gone.
+ *
+ * @param       directory Relative to the project root, which is the working directory.
+ * @return      0 if everything was loaded, -1 if anything failed.
+ */
+int web_static_cache_add_directory(const char *directory, unsigned short public) {
+    if (static_cache_watches_count == STATIC_CACHE_MAX_WATCHES) {
+        fprintf(stderr, "Too many folders to watch for static files\nError code: %d\n", errno);
+        return -1;
+    }
+
+    int watch_descriptor = inotify_add_watch(static_cache_inotify_fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CREATE);
+    if (watch_descriptor == -1) {
+        fprintf(stderr, "Failed to watch folder %s\nError code: %d\n", directory, errno);
+        return -1;
+    }
+
+    /** Watching a folder twice gives back the same descriptor, folders are only recorded once */
+    unsigned int i;
+    for (i = 0; i < static_cache_watches_count; i++) {
+        if (static_cache_watches[i].watch_descriptor == watch_descriptor) {
+            break;
+        }
+    }
+
+    if (i == static_cache_watches_count) {
+        StaticCacheWatch *watch = &static_cache_watches[static_cache_watches_count];
+        watch->watch_descriptor = watch_descriptor;
+        watch->public = public;
+        watch->directory = (char *)malloc(strlen(directory) + 1);
+        if (watch->directory == NULL) {
+            fprintf(stderr, "Failed to allocate memory for watch->directory\nError code: %d\n", errno);
+            return -1;
+        }
+
+        strcpy(watch->directory, directory);
+        static_cache_watches_count++;
+    }
+
+    DIR *dir = opendir(directory);
+    if (dir == NULL) {
+        fprintf(stderr, "Failed to open folder %s\nError code: %d\n", directory, errno);
+        return -1;
+    }
+
+    int retval = 0;
+    struct dirent *dir_entry;
+    while ((dir_entry = readdir(dir)) != NULL) {
+        if (dir_entry->d_name[0] == '.') {
+            continue;
+        }
+
+        char path[PATH_MAX];
+        if (snprintf(path, sizeof path, "%s/%s", directory, dir_entry->d_name) >= (int)sizeof path) {
+            continue;
+        }
+
+        struct stat path_stat;
+        if (stat(path, &path_stat) == -1) {
+            continue;
+        }
+
+        if (S_ISDIR(path_stat.st_mode)) {
+            if (web_static_cache_add_directory(path, strcmp(path, "src/web/pages/public") == 0) == -1) {
+                retval = -1;
+            }
+        } else if (S_ISREG(path_stat.st_mode)) {
+            if (web_static_cache_load(path, public) == -1) {
+                /** Deleted since it was listed, the rescan drops it. Otherwise the previous version is still served */
+                if (access(path, F_OK) == 0) {
+                    web_static_cache_keep(path, public);
+                }
+
+                retval = -1;
+            }
+        }
+    }
+
+    closedir(dir);
+
+    return retval;
+}
+
+/**
+ * Maps a file to the url it is served at: public pages by their name at the root ("/about" for
+ * src/web/pages/public/about.html) and assets by their path.
+ *
+ * @param[out]  url At least PATH_MAX bytes.
+ * @return      0 on success, 1 for files that aren't served.
+ */
+int web_static_cache_url(char *url, const char *file_path, unsigned short public, const char **content_type) {
+    size_t file_path_length = strlen(file_path);
+
+    *content_type = web_static_content_type(file_path, file_path_length);
+    if (*content_type != NULL) {
+        sprintf(url, "/%s", file_path);
+        return 0;
+    }
+
+    const char *name = strrchr(file_path, '/') + 1;
+    size_t name_length = strlen(name);
+    if (public && name_length > 5 && strcmp(name + name_length - 5, ".html") == 0) {
+        *content_type = "text/html";
+        sprintf(url, "/%.*s", (int)(name_length - 5), name);
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Reads a file and makes its response the one served from now on, replacing any previous version.
+ */
+int web_static_cache_load(const char *file_path, unsigned short public) {
+    char url[PATH_MAX + 1];
+    const char *content_type;
+    if (web_static_cache_url(url, file_path, public, &content_type) == 1) {
+        return 0;
+    }
+
+    int file_fd = open(file_path, O_RDONLY);
+    if (file_fd == -1) {
+        fprintf(stderr, "Failed to open file %s\nError code: %d\n", file_path, errno);
+        return -1;
+    }
+
+    struct stat file_stat;
+    if (fstat(file_fd, &file_stat) == -1) {
+        fprintf(stderr, "Failed to get status of file %s\nError code: %d\n", file_path, errno);
+        close(file_fd);
+        return -1;
+    }
+
+    size_t body_length = file_stat.st_size;
+
+    if (body_length > STATIC_CACHE_MAX_FILE_SIZE) {
+        close(file_fd);
+        web_static_cache_remove(file_path, public);
+        return 0;
+    }
+
+    /**
+     * The response, the headers of every variant and the raw body are a single allocation, freed
+     * with the last reference along with the compressed bodies.
+     */
+    StaticResponse *response = (StaticResponse *)malloc(sizeof(StaticResponse) + STATIC_ENCODINGS_COUNT * STATIC_CACHE_HEADERS_CAPACITY + body_length);
+    if (response == NULL) {
+        fprintf(stderr, "Failed to allocate memory for response\nError code: %d\n", errno);
+        close(file_fd);
+        return -1;
+    }
+
+    char *headers = (char *)(response + 1);
+    char *body = headers + STATIC_ENCODINGS_COUNT * STATIC_CACHE_HEADERS_CAPACITY;
+
+    size_t read_length = 0;
+    while (read_length < body_length) {
+        ssize_t read_now = read(file_fd, body + read_length, body_length - read_length);
+        if (read_now == -1 && errno == EINTR) {
+            continue;
+        }
+
+        if (read_now <= 0) {
+            fprintf(stderr, "Failed to read file %s\nError code: %d\n", file_path, errno);
+            free(response);
+            close(file_fd);
+            return -1;
+        }
+
+        read_length += read_now;
+    }
+
+    close(file_fd);
+
+    response->references = 1;
+    response->content_type = content_type;
+
+    StaticVariant *identity = &response->variants[STATIC_ENCODING_IDENTITY];
+    identity->body = body;
+    identity->body_length = body_length;
+
+    unsigned short encoding;
+    for (encoding = 0; encoding < STATIC_ENCODING_IDENTITY; encoding++) {
+        if (web_static_cache_compress(&response->variants[encoding], body, body_length, static_cache_encoding_window_bits[encoding]) == -1) {
+            response->variants[encoding].body = NULL;
+        }
+    }
+
+    response->last_modified = file_stat.st_mtime;
+
+    struct tm last_modified_tm;
+    char last_modified[32];
+    strftime(last_modified, sizeof last_modified, "%a, %d %b %Y %H:%M:%S GMT", gmtime_r(&response->last_modified, &last_modified_tm));
+
+    /** Every variant gets its own strong ETag: the bytes differ, so caches must not mix them up */
+    unsigned long etag = hash_fnv1a(body, body_length);
+    for (encoding = 0; encoding < STATIC_ENCODINGS_COUNT; encoding++) {
+        StaticVariant *variant = &response->variants[encoding];
+        char *variant_headers = headers + encoding * STATIC_CACHE_HEADERS_CAPACITY;
+
+        variant->headers = variant_headers;
+        variant->headers_length = sprintf(variant_headers, "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %lu\r\nAccept-Ranges: bytes\r\n", content_type, (unsigned long)variant->body_length);
+
+        if (encoding != STATIC_ENCODING_IDENTITY) {
+            variant->headers_length += sprintf(variant_headers + variant->headers_length, "Content-Encoding: %s\r\n", static_cache_encoding_names[encoding]);
+        }
+
+        variant->validators = variant_headers + variant->headers_length;
+        variant->validators_length = sprintf(variant_headers + variant->headers_length, "ETag: \"%016lx%s%s\"\r\nLast-Modified: %s\r\nVary: Accept-Encoding\r\n", etag,
+                                             encoding == STATIC_ENCODING_IDENTITY ? "" : "-", encoding == STATIC_ENCODING_IDENTITY ? "" : static_cache_encoding_names[encoding], last_modified);
+        variant->headers_length += variant->validators_length;
+
+        variant->etag = variant->validators + strlen("ETag: ");
+        variant->etag_length = (const char *)memchr(variant->etag, '\r', variant->validators_length) - variant->etag;
+    }
+
+    pthread_mutex_lock(&static_cache_mutex);
+
+    StaticCacheEntry *entry = web_static_cache_find(url, strlen(url));
+    if (entry->url == NULL) {
+        if ((static_cache_entries_count + 1) * 4 > STATIC_CACHE_CAPACITY * 3 || (entry->url = (char *)malloc(strlen(url) + 1)) == NULL) {
+            pthread_mutex_unlock(&static_cache_mutex);
+            fprintf(stderr, "Failed to add %s to the static cache\nError code: %d\n", file_path, errno);
+            web_static_cache_release(response);
+            return -1;
+        }
+
+        strcpy(entry->url, url);
+        entry->url_length = strlen(url);
+        static_cache_entries_count++;
+    }
+
+    StaticResponse *previous_response = entry->response;
+    entry->response = response;
+    entry->generation = static_cache_generation;
+
+    pthread_mutex_unlock(&static_cache_mutex);
+
+    web_static_cache_release(previous_response);
+
+    return 0;
+}
+
+/**
+ * Marks the cached version of a file as found by the current scan, so the rescan doesn't drop it.
+ */
+void web_static_cache_keep(const char *file_path, unsigned short public) {
+    char url[PATH_MAX + 1];
+    const char *content_type;
+    if (web_static_cache_url(url, file_path, public, &content_type) == 1) {
+        return;
+    }
+
+    pthread_mutex_lock(&static_cache_mutex);
+
+    StaticCacheEntry *entry = web_static_cache_find(url, strlen(url));
+    if (entry->url != NULL) {
+        entry->generation = static_cache_generation;
+    }
+
+    pthread_mutex_unlock(&static_cache_mutex);
+}
+
+void web_static_cache_remove(const char *file_path, unsigned short public) {
+    char url[PATH_MAX + 1];
+    const char *content_type;
+    if (web_static_cache_url(url, file_path, public, &content_type) == 1) {
+        return;
+    }
+
+    pthread_mutex_lock(&static_cache_mutex);
+
+    StaticCacheEntry *entry = web_static_cache_find(url, strlen(url));
+    StaticResponse *previous_response = entry->response;
+    entry->response = NULL;
+
+    pthread_mutex_unlock(&static_cache_mutex);
+
+    web_static_cache_release(previous_response);
+}
+
+/**
+ * Open addressing with linear probing. Must be called with static_cache_mutex held.
+ *
+ * @return      The entry for url, or the empty slot where it would go.
+ */
+StaticCacheEntry *web_static_cache_find(const char *url, size_t url_length) {
+    unsigned long slot = hash_fnv1a(url, url_length) & (STATIC_CACHE_CAPACITY - 1);
+
+    while (static_cache_entries[slot].url != NULL) {
+        StaticCacheEntry *entry = &static_cache_entries[slot];
+        if (entry->url_length == url_length && memcmp(entry->url, url, url_length) == 0) {
+            return entry;
+        }
+
+        slot = (slot + 1) & (STATIC_CACHE_CAPACITY - 1);
+    }
+
+    return &static_cache_entries[slot];
+}
+
+/**
+ * Compresses body into a variant, in the gzip or zlib format depending on window_bits.
+ *
+ * @return      0 on success, -1 if compressing failed or didn't make the body smaller, in which
+ *              case the variant is left without a body.
+ */
+int web_static_cache_compress(StaticVariant *variant, const char *body, size_t body_length, int window_bits) {
+    variant->body = NULL;
+    variant->body_length = 0;
+
+    z_stream stream;
+    memset(&stream, 0, sizeof stream);
+
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, window_bits, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        fprintf(stderr, "Failed to initialize compression stream\nError code: %d\n", errno);
+        return -1;
+    }
+
+    size_t capacity = deflateBound(&stream, body_length);
+    char *compressed = (char *)malloc(capacity);
+    if (compressed == NULL) {
+        fprintf(stderr, "Failed to allocate memory for compressed\nError code: %d\n", errno);
+        deflateEnd(&stream);
+        return -1;
+    }
+
+    stream.next_in = (Bytef *)body;
+    stream.avail_in = body_length;
+    stream.next_out = (Bytef *)compressed;
+    stream.avail_out = capacity;
+
+    int status = deflate(&stream, Z_FINISH);
+    size_t compressed_length = stream.total_out;
+    deflateEnd(&stream);
+
+    if (status != Z_STREAM_END || compressed_length >= body_length) {
+        free(compressed);
+        return -1;
+    }
+
+    variant->body = compressed;
+    variant->body_length = compressed_length;
+
+    return 0;
+}
+
+void web_static_cache_release(StaticResponse *response) {
+    if (response == NULL || __sync_sub_and_fetch(&response->references, 1) != 0) {
+        return;
+    }
+
+    unsigned short encoding;
+    for (encoding = 0; encoding < STATIC_ENCODING_IDENTITY; encoding++) {
+        free((char *)response->variants[encoding].body);
+        response->variants[encoding].body = NULL;
+    }
+
+    free(response);
+}
+
+/**
+ * Start routine of the watcher thread: applies the changes inotify reports until the program exits.
+ * A folder created or moved in is watched and loaded with everything already in it. When the queue
+ * overflowed, the events lost are made up for by a rescan.
+ */
+void *web_static_cache_watch(void *arg) {
+    /** Aligned for the struct inotify_event read into it */
+    union {
+        struct inotify_event event;
+        char bytes[4096];
+    } buffer;
+
+    struct pollfd watched;
+    watched.fd = static_cache_inotify_fd;
+    watched.events = POLLIN;
+
+    while (keep_running) {
+        if (static_cache_rescan_requested) {
+            static_cache_rescan_requested = 0;
+            web_static_cache_rescan();
+        }
+
+        if (poll(&watched, 1, EVENT_LOOP_TIMEOUT_MS) <= 0) {
+            continue;
+        }
+
+        ssize_t length = read(static_cache_inotify_fd, buffer.bytes, sizeof buffer.bytes);
+        if (length <= 0) {
+            continue;
+        }
+
+        char *position = buffer.bytes;
+        while (position < buffer.bytes + length) {
+            struct inotify_event *event = (struct inotify_event *)position;
+            position += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                static_cache_rescan_requested = 1;
+                continue;
+            }
+
+            if (event->len == 0 || event->name[0] == '.') {
+                continue;
+            }
+
+            /** The files of a folder moved away get no event of their own */
+            if ((event->mask & IN_ISDIR) && (event->mask & IN_MOVED_FROM)) {
+                static_cache_rescan_requested = 1;
+                continue;
+            }
+
+            /** A file just created is loaded once it is written (IN_CLOSE_WRITE), folders right away */
+            if ((event->mask & IN_ISDIR) ? !(event->mask & (IN_CREATE | IN_MOVED_TO)) : (event->mask & IN_CREATE) != 0) {
+                continue;
+            }
+
+            unsigned int i;
+            for (i = 0; i < static_cache_watches_count; i++) {
+                if (static_cache_watches[i].watch_descriptor == event->wd) {
+                    break;
+                }
+            }
+
+            if (i == static_cache_watches_count) {
+                continue;
+            }
+
+            char path[PATH_MAX];
+            if (snprintf(path, sizeof path, "%s/%s", static_cache_watches[i].directory, event->name) >= (int)sizeof path) {
+                continue;
+            }
+
+            if (event->mask & IN_ISDIR) {
+                /** Files written before the watch was added are found by listing the folder */
+                web_static_cache_add_directory(path, strcmp(path, "src/web/pages/public") == 0);
+            } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                web_static_cache_remove(path, static_cache_watches[i].public);
+            } else {
+                web_static_cache_load(path, static_cache_watches[i].public);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Loads every file again, and drops the ones that were not found anymore. Runs on the watcher
+ * thread, the only one that touches the folders being watched.
+ */
+void web_static_cache_rescan(void) {
+    static_cache_generation++;
+
+    /** Both folders are scanned even if the first one had a file failing */
+    int static_status = web_static_cache_add_directory("src/web/static", 0);
+    int pages_status = web_static_cache_add_directory("src/web/pages", 0);
+
+    if (static_status == -1 || pages_status == -1) {
+        fprintf(stderr, "Failed to reload some static files, they keep their previous version\nError code: %d\n", errno);
+    }
+
+    StaticResponse *removed[STATIC_CACHE_CAPACITY];
+    unsigned int removed_count = 0;
+
+    pthread_mutex_lock(&static_cache_mutex);
+
+    unsigned int i;
+    for (i = 0; i < STATIC_CACHE_CAPACITY; i++) {
+        StaticCacheEntry *entry = &static_cache_entries[i];
+
+        if (entry->response != NULL && entry->generation != static_cache_generation) {
+            removed[removed_count++] = entry->response;
+            entry->response = NULL;
+        }
+    }
+
+    pthread_mutex_unlock(&static_cache_mutex);
+
+    for (i = 0; i < removed_count; i++) {
+        web_static_cache_release(removed[i]);
+    }
+
+    printf("Static cache reloaded: %u files dropped\n", removed_count);
+}
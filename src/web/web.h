@@ -1,33 +1,162 @@
 #ifndef WEB_H
 #define WEB_H
 
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
+
+#define HTTP_METHOD_UNKNOWN 0
+#define HTTP_METHOD_GET 1
+#define HTTP_METHOD_HEAD 2
+#define HTTP_METHOD_POST 3
+#define HTTP_METHOD_PUT 4
+#define HTTP_METHOD_DELETE 5
+#define HTTP_METHOD_PATCH 6
+#define HTTP_METHOD_OPTIONS 7
+
+/** HTTP versions are stored as major * 10 + minor */
+#define HTTP_VERSION_1_0 10
+#define HTTP_VERSION_1_1 11
+
+/** Headers looked up often enough to be indexed while parsing, see HttpRequest.known_headers */
+#define HTTP_HEADER_HOST 0
+#define HTTP_HEADER_CONTENT_LENGTH 1
+#define HTTP_HEADER_COOKIE 2
+#define HTTP_HEADER_ACCEPT_ENCODING 3
+#define HTTP_HEADER_IF_NONE_MATCH 4
+#define HTTP_HEADER_HX_REQUEST 5
+#define HTTP_HEADER_IF_MODIFIED_SINCE 6
+#define HTTP_HEADER_RANGE 7
+#define HTTP_HEADER_IF_RANGE 8
+#define HTTP_KNOWN_HEADERS_COUNT 9
+
+/** Requests with more header lines are rejected */
+#define HTTP_MAX_HEADERS 64
+
+/** Range requests asking for more ranges get the whole file */
+#define HTTP_MAX_RANGES 8
+
+/** Room for the status line and headers of a response, see HttpResponse */
+#define HTTP_RESPONSE_HEADERS_CAPACITY 1024
+
+/** Separate pieces of memory the body of a response can be gathered from */
+#define HTTP_RESPONSE_MAX_BODY_SEGMENTS 8
+
+/** Parameter and wildcard segments a route can capture, see HttpRequest.route_params */
+#define ROUTE_MAX_PARAMS 4
+
+/** A run of characters inside a larger string, not null-terminated */
+typedef struct {
+    const char *start;
+    size_t length;
+} StringView;
+
+typedef struct {
+    StringView name;
+    StringView value; /** Without surrounding whitespace */
+} HttpHeader;
+
+/**
+ * A parsed request. Every field points into the buffer the request was read into, so the request is
+ * only valid for as long as that buffer is, and nothing has to be freed.
+ */
 typedef struct {
-    char *method;
-    char *url;
-    char *query_params;
-    char *http_version;
-    char *headers;
-    char *body;
+    unsigned short method; /** One of HTTP_METHOD_* */
+    unsigned short http_version; /** One of HTTP_VERSION_* */
+    StringView url; /** Path only, without the query params */
+    StringView query_params; /** Without the leading '?', empty if there are none */
+    StringView headers; /** Every header line, without the request line and the blank line that ends them */
+    StringView body;
+    HttpHeader header_table[HTTP_MAX_HEADERS]; /** In the order they were sent */
+    unsigned short headers_count;
+    short known_headers[HTTP_KNOWN_HEADERS_COUNT]; /** Index in header_table of the first HTTP_HEADER_* header, -1 if absent */
+    StringView route_params[ROUTE_MAX_PARAMS]; /** Segments matched by the ":name" and "*" segments of the route, in order */
+    unsigned short route_params_count;
 } HttpRequest;
 
-char ***web_utils_matrix_2d_allocation(char ***p_matrix, unsigned short level1_size, unsigned short level2_size);
-void web_utils_matrix_2d_free(char ***p_matrix, unsigned short level1_size);
-int web_utils_parse_http_request(HttpRequest *parsed_http_request, const char *http_request);
-void web_utils_http_request_free(HttpRequest *parsed_http_request);
-int web_utils_parse_value(char **buffer, const char key_name[], char *string);
+/** A satisfiable range of a Range header, resolved against the size of the file */
+typedef struct {
+    size_t start;
+    size_t length;
+} ByteRange;
+
+/**
+ * A response being assembled by the web_response_* functions, see response.c. Lives on the stack of
+ * the handler, nothing in it has to be freed.
+ */
+typedef struct {
+    int client_socket;
+    unsigned short status;
+    char headers[HTTP_RESPONSE_HEADERS_CAPACITY]; /** Status line and headers, Content-Length, Date and Connection are added when sent */
+    size_t headers_length;
+    unsigned short headers_overflow; /** A header didn't fit, the response can't be sent */
+    struct iovec body[HTTP_RESPONSE_MAX_BODY_SEGMENTS]; /** Point into memory owned by the handler */
+    unsigned short body_segments_count;
+    size_t body_length;
+    int file_fd; /** -1 unless the body is a range of a file, see web_response_file */
+    off_t file_offset;
+    unsigned short chunked; /** The headers went out with Transfer-Encoding: chunked, see web_response_stream */
+    unsigned short headers_only; /** Answers a HEAD request, the body is described by the headers but not sent */
+} HttpResponse;
+
+/** Every route is served by a handler with this signature, see web_routes in router.c */
+typedef int (*WebHandler)(int client_socket, HttpRequest *request);
+
+int web_utils_parse_http_request(HttpRequest *parsed_http_request, const char *http_request, size_t http_request_length);
+unsigned int web_utils_string_view_equals(StringView view, const char *string);
+const StringView *web_utils_find_header(const HttpRequest *request, const char *name);
+const StringView *web_utils_known_header(const HttpRequest *request, unsigned short known_header);
+unsigned int web_utils_hx_request(const HttpRequest *request);
+unsigned int web_utils_accepts_encoding(const HttpRequest *request, const char *coding);
+int web_utils_parse_value(char **buffer, const char key_name[], const char *string);
 int web_utils_url_decode(char **string);
+int web_utils_send_file_range(int client_socket, int file_fd, off_t offset, size_t length);
+unsigned int web_utils_etag_matches(StringView if_none_match, const char *etag, size_t etag_length);
+int web_utils_parse_http_date(StringView date, time_t *time);
+int web_utils_send_all(int client_socket, struct iovec *iov, int iovcnt, int flags);
+
+void web_response_init(HttpResponse *response, int client_socket, const HttpRequest *request, unsigned short status);
+void web_response_header(HttpResponse *response, const char *name, const char *value);
+void web_response_header_lines(HttpResponse *response, const char *lines, size_t lines_length);
+int web_response_body(HttpResponse *response, const char *body, size_t body_length);
+void web_response_file(HttpResponse *response, int file_fd, off_t offset, size_t length);
+void web_response_revalidate(HttpResponse *response, HttpRequest *request);
+int web_response_send(HttpResponse *response);
+int web_response_send_status(int client_socket, unsigned short status);
+size_t web_response_stream(HttpResponse *response, HttpRequest *request);
+int web_response_stream_write(void *response, const char *data, size_t length);
+int web_response_stream_end(HttpResponse *response, HttpRequest *request, const char *data, size_t length);
+size_t web_response_framing_headers(char *buffer, int client_socket, size_t body_length);
+size_t web_response_final_headers(char *buffer, int client_socket);
+
+int web_router_init(void);
+void web_router_free(void);
+int web_router_dispatch(int client_socket, HttpRequest *request);
 
-int web_static(int client_socket, char *path, const char *response_headers, size_t response_headers_length);
+int web_static(int client_socket, HttpRequest *request, char *path, const char *content_type);
+unsigned int web_static_not_modified(HttpRequest *request, const char *etag, size_t etag_length, time_t last_modified);
+int web_static_parse_ranges(HttpRequest *request, const char *etag, size_t etag_length, time_t last_modified, size_t size, ByteRange *ranges);
+int web_static_send_ranges(int client_socket, const HttpRequest *request, const char *content_type, const char *validators, size_t size, const ByteRange *ranges, unsigned short ranges_count, const char *body, int file_fd);
+int web_static_send_range_not_satisfiable(int client_socket, const HttpRequest *request, size_t size);
 int construct_public_route_file_path(char **path_buffer, char *url);
-unsigned int requested_public_route(const char *url);
+int web_static_file_get(int client_socket, HttpRequest *request);
+int web_static_cache_init(void);
+void web_static_cache_free(void);
+void web_static_cache_reload(void);
+int web_static_cache_send(int client_socket, HttpRequest *request);
+const char *web_static_content_type(const char *file_path, size_t file_path_length);
+int web_public_route_get(int client_socket, HttpRequest *request);
+unsigned int has_file_extension(StringView file_path, const char *extension);
 
-int web_ui_test_get(int client_socket, HttpRequest *request, int conn_index);
+int web_ui_test_get(int client_socket, HttpRequest *request);
 
 int web_home_get(int client_socket, HttpRequest *request);
 
 int web_sign_up_get(int client_socket, HttpRequest *request);
-int web_sign_up_create_user_post(int client_socket, HttpRequest *request, int conn_index);
+int web_sign_up_create_user_post(int client_socket, HttpRequest *request);
 
 int web_not_found(int client_socket, HttpRequest *request);
+int web_method_not_allowed(int client_socket, HttpRequest *request, const char *allow_header);
 
 #endif
\ No newline at end of file
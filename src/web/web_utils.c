@@ -4,261 +4,390 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "server/server.h"
 #include "utils/utils.h"
 #include "web/web.h"
 
-char ***web_utils_matrix_2d_allocation(char ***p_matrix, unsigned short level1_size, unsigned short level2_size) {
-    p_matrix = (char ***)malloc(level1_size * sizeof(char **));
-    if (p_matrix == NULL) {
-        fprintf(stderr, "Failed to allocate memory for p_matrix level 1\nError code: %d\n", errno);
-        return NULL;
-    }
-
-    unsigned short i;
-    for (i = 0; i < level1_size; ++i) {
-        p_matrix[i] = (char **)malloc(level2_size * sizeof(char *));
-        if (p_matrix[i] == NULL) {
-            fprintf(stderr, "Failed to allocate memory for p_matrix[%d] at level 2\nError code: %d\n", i, errno);
-            unsigned short k;
-            for (k = 0; k < i; ++k) {
-                free(p_matrix[k]);
-                p_matrix[k] = NULL;
-            }
-            free(p_matrix);
-            p_matrix = NULL;
-            return NULL;
-        }
-    }
-
-    return p_matrix;
-}
-
-void web_utils_matrix_2d_free(char ***p_matrix, unsigned short level1_size) {
-    unsigned short i;
-
-    for (i = 0; i < level1_size; i++) {
-        free(p_matrix[i]);
-        p_matrix[i] = NULL;
-    }
-
-    free(p_matrix);
-    p_matrix = NULL;
-}
-
-int web_utils_parse_http_request(HttpRequest *parsed_http_request, const char *http_request) {
-    parsed_http_request->method = NULL;
-    parsed_http_request->url = NULL;
-    parsed_http_request->query_params = NULL;
-    parsed_http_request->body = NULL;
-    parsed_http_request->http_version = NULL;
-    parsed_http_request->headers = NULL;
+unsigned short web_utils_parse_http_method(const char *method, size_t method_length);
+int web_utils_known_header_index(StringView name);
+unsigned int web_utils_ascii_case_equals(const char *a, const char *b, size_t length);
+unsigned int web_utils_zero_quality(const char *parameters, const char *end);
+
+/** Indexed by HTTP_HEADER_* */
+const char *web_utils_known_header_names[HTTP_KNOWN_HEADERS_COUNT] = {"Host", "Content-Length", "Cookie", "Accept-Encoding", "If-None-Match", "HX-Request", "If-Modified-Since", "Range", "If-Range"};
+const size_t web_utils_known_header_lengths[HTTP_KNOWN_HEADERS_COUNT] = {4, 14, 6, 15, 13, 10, 17, 5, 8};
+
+/** HTTP_HEADER_* by hash of the header name, see web_utils_known_header_index */
+const int web_utils_known_header_slots[32] = {
+    HTTP_HEADER_HOST, -1, -1, -1, -1, -1, HTTP_HEADER_HX_REQUEST, -1,
+    -1, -1, -1, -1, -1, -1, HTTP_HEADER_COOKIE, -1,
+    -1, -1, -1, -1, -1, -1, HTTP_HEADER_IF_RANGE, HTTP_HEADER_ACCEPT_ENCODING,
+    -1, HTTP_HEADER_CONTENT_LENGTH, -1, -1, HTTP_HEADER_RANGE, -1, HTTP_HEADER_IF_NONE_MATCH, HTTP_HEADER_IF_MODIFIED_SINCE};
+
+/**
+ * Parses a request without copying it: every field of parsed_http_request is a view into
+ * http_request, which must outlive it.
+ *
+ * @param       http_request A complete request, as framed by server_connection_frame_request.
+ * @param       http_request_length Length of the request, pipelined bytes past it are not looked at.
+ * @return      0 if success, -1 if the request is malformed.
+ */
+int web_utils_parse_http_request(HttpRequest *parsed_http_request, const char *http_request, size_t http_request_length) {
+    const char *request_end = http_request + http_request_length;
 
     /** 1. Extract http request method */
-    const char *method_end = strchr(http_request, ' ');
-    size_t method_length = method_end - http_request;
-    parsed_http_request->method = (char *)malloc(method_length * (sizeof parsed_http_request->method) + 1);
-    if (parsed_http_request->method == NULL) {
-        fprintf(stderr, "Failed to allocate memory for parsed_http_request->method\nError code: %d\n", errno);
-        return -1;
-    }
-
-    if (memcpy(parsed_http_request->method, http_request, method_length) == NULL) {
-        fprintf(stderr, "Failed to copy method from http request into structure\nError code: %d\n", errno);
-        web_utils_http_request_free(parsed_http_request);
+    const char *method_end = memchr(http_request, ' ', http_request_length);
+    if (method_end == NULL) {
+        fprintf(stderr, "Failed to find char\nError code: %d\n", errno);
         return -1;
     }
 
-    parsed_http_request->method[method_length] = '\0';
+    parsed_http_request->method = web_utils_parse_http_method(http_request, method_end - http_request);
 
     /** 2. Extract http request url and 3. url query params */
     const char *url_start = method_end + 1;
-    const char *url_end;
-    if ((url_end = strchr(url_start, ' ')) == NULL) {
+    const char *url_end = memchr(url_start, ' ', request_end - url_start);
+    if (url_end == NULL) {
         fprintf(stderr, "Failed to find char\nError code: %d\n", errno);
-        web_utils_http_request_free(parsed_http_request);
         return -1;
     }
 
-    const char *query_params_start = url_start;
-
-    int query_params_start_index = -1; /** We start assuming there isn't any query params */
-    /** Iterate until whitespace is found */
-    while (!isspace((unsigned char)*query_params_start)) {
-        /** If a '?' char is found along the way, that's the start of the query params */
-        if (*query_params_start == '?') {
-            query_params_start_index = query_params_start - http_request;
-            break;
-        }
-
-        /* Keep moving forward */
-        query_params_start++;
+    const char *query_params_start = memchr(url_start, '?', url_end - url_start);
+    if (query_params_start != NULL) {
+        parsed_http_request->url.start = url_start;
+        parsed_http_request->url.length = query_params_start - url_start;
+        parsed_http_request->query_params.start = query_params_start + 1; /** Skip '?' char found at the beginning of query params */
+        parsed_http_request->query_params.length = url_end - (query_params_start + 1);
+    } else {
+        parsed_http_request->url.start = url_start;
+        parsed_http_request->url.length = url_end - url_start;
+        parsed_http_request->query_params.start = url_end;
+        parsed_http_request->query_params.length = 0;
     }
 
-    size_t query_params_length = 0;
-    if (query_params_start_index >= 0) {
-        query_params_length = url_end - (query_params_start + 1); /** Skip '?' char found at the beginning of query params */
-        /**
-         * Because we separate the url and url query params, we set
-         * the end of the url to where the url query params start
-         */
-        url_end = &http_request[query_params_start_index];
+    /** 4. Extract http version from request, only "HTTP/<digit>.<digit>" is accepted */
+    const char *http_version_start = url_end + 1;
+    if (request_end - http_version_start < 10 || memcmp(http_version_start, "HTTP/", 5) != 0 || !isdigit((unsigned char)http_version_start[5]) ||
+        http_version_start[6] != '.' || !isdigit((unsigned char)http_version_start[7]) || memcmp(http_version_start + 8, "\r\n", 2) != 0) {
+        fprintf(stderr, "Malformed http version\nError code: %d\n", errno);
+        return -1;
     }
 
-    size_t url_len = url_end - url_start;
+    parsed_http_request->http_version = (http_version_start[5] - '0') * 10 + (http_version_start[7] - '0');
 
-    parsed_http_request->url = (char *)malloc(url_len * (sizeof parsed_http_request->url) + 1);
-    if (parsed_http_request->url == NULL) {
-        fprintf(stderr, "Failed to allocate memory for parsed_http_request->url\nError code: %d\n", errno);
-        web_utils_http_request_free(parsed_http_request);
-        return -1;
+    /** 5. Extract http request headers, one line at a time until the blank line that ends them */
+    const char *request_line_end = http_version_start + 8;
+    const char *headers_start = request_line_end + 2; /* Skip "\r\n" */
+    const char *line = headers_start;
+
+    parsed_http_request->headers_count = 0;
+
+    unsigned short i;
+    for (i = 0; i < HTTP_KNOWN_HEADERS_COUNT; i++) {
+        parsed_http_request->known_headers[i] = -1;
     }
 
-    if (memcpy(parsed_http_request->url, url_start, url_len) == NULL) {
-        fprintf(stderr, "Failed to copy url from http request into structure\nError code: %d\n", errno);
-        web_utils_http_request_free(parsed_http_request);
+    /** Every header line plus the empty line, found in a single pass over the headers */
+    const char *line_ends[HTTP_MAX_HEADERS + 1];
+    size_t line_ends_count = find_crlfs(headers_start, request_end, line_ends, HTTP_MAX_HEADERS + 1);
+
+    if (line_ends_count == 0 || line_ends[line_ends_count - 1] != (line_ends_count > 1 ? line_ends[line_ends_count - 2] + 2 : headers_start)) {
+        fprintf(stderr, "Failed to find the end of the headers, or too many headers\nError code: %d\n", errno);
         return -1;
     }
 
-    parsed_http_request->url[url_len] = '\0';
+    for (i = 0; (size_t)i + 1 < line_ends_count; i++) {
+        const char *line_end = line_ends[i];
 
-    if (query_params_length > 0) {
-        parsed_http_request->query_params = (char *)malloc(query_params_length * (sizeof parsed_http_request->query_params) + 1);
-        if (parsed_http_request->query_params == NULL) {
-            fprintf(stderr, "Failed to allocate memory for parsed_http_request->query_params\nError code: %d\n", errno);
-            web_utils_http_request_free(parsed_http_request);
+        /** No whitespace before the colon (RFC 9112, section 5.1), server_connection_frame_request refuses such requests too */
+        const char *colon = memchr(line, ':', line_end - line);
+        if (colon == NULL || colon == line || memchr(line, ' ', colon - line) != NULL || memchr(line, '\t', colon - line) != NULL) {
+            fprintf(stderr, "Malformed header\nError code: %d\n", errno);
             return -1;
         }
 
-        /** (query_params_start + 1) -> skip '?' char found at the beginning of query params */
-        if (memcpy(parsed_http_request->query_params, (query_params_start + 1), query_params_length) == NULL) {
-            fprintf(stderr, "Failed to copy url query params from http request into structure\nError code: %d\n", errno);
-            web_utils_http_request_free(parsed_http_request);
-            return -1;
+        const char *value = colon + 1;
+        while (value < line_end && (*value == ' ' || *value == '\t')) {
+            value++;
+        }
+
+        const char *value_end = line_end;
+        while (value_end > value && (*(value_end - 1) == ' ' || *(value_end - 1) == '\t')) {
+            value_end--;
+        }
+
+        HttpHeader *header = &parsed_http_request->header_table[parsed_http_request->headers_count];
+        header->name.start = line;
+        header->name.length = colon - line;
+        header->value.start = value;
+        header->value.length = value_end - value;
+
+        int known_header = web_utils_known_header_index(header->name);
+        if (known_header != -1 && parsed_http_request->known_headers[known_header] == -1) {
+            parsed_http_request->known_headers[known_header] = parsed_http_request->headers_count;
         }
 
-        parsed_http_request->query_params[query_params_length] = '\0';
+        parsed_http_request->headers_count++;
+
+        line = line_end + 2; /* Skip "\r\n" */
     }
 
-    /** 4. Extract http version from request */
-    char *http_version_start;
-    if ((http_version_start = strchr(query_params_start, ' ')) == NULL) {
-        web_utils_http_request_free(parsed_http_request);
-        fprintf(stderr, "Failed to find char\nError code: %d\n", errno);
-        return -1;
+    parsed_http_request->headers.start = headers_start;
+    parsed_http_request->headers.length = line > headers_start ? (size_t)(line - 2 - headers_start) : 0;
+
+    /** 6. Extract http request body, it runs until the end of the request */
+    parsed_http_request->body.start = line + 2; /* Skip "\r\n" */
+    parsed_http_request->body.length = request_end - parsed_http_request->body.start;
+
+    return 0;
+}
+
+unsigned short web_utils_parse_http_method(const char *method, size_t method_length) {
+    switch (method_length) {
+    case 3:
+        if (memcmp(method, "GET", 3) == 0) {
+            return HTTP_METHOD_GET;
+        }
+        if (memcmp(method, "PUT", 3) == 0) {
+            return HTTP_METHOD_PUT;
+        }
+        break;
+    case 4:
+        if (memcmp(method, "POST", 4) == 0) {
+            return HTTP_METHOD_POST;
+        }
+        if (memcmp(method, "HEAD", 4) == 0) {
+            return HTTP_METHOD_HEAD;
+        }
+        break;
+    case 5:
+        if (memcmp(method, "PATCH", 5) == 0) {
+            return HTTP_METHOD_PATCH;
+        }
+        break;
+    case 6:
+        if (memcmp(method, "DELETE", 6) == 0) {
+            return HTTP_METHOD_DELETE;
+        }
+        break;
+    case 7:
+        if (memcmp(method, "OPTIONS", 7) == 0) {
+            return HTTP_METHOD_OPTIONS;
+        }
+        break;
     }
 
-    http_version_start++; /* Skip space */
+    return HTTP_METHOD_UNKNOWN;
+}
 
-    char *http_version_end;
-    if ((http_version_end = strstr(http_version_start, "\r\n")) == NULL) {
-        fprintf(stderr, "Failed to find string\nError code: %d\n", errno);
-        web_utils_http_request_free(parsed_http_request);
+/**
+ * @return      The HTTP_HEADER_* constant of the header, -1 if it is not one of the indexed headers.
+ */
+int web_utils_known_header_index(StringView name) {
+    if (name.length == 0) {
         return -1;
     }
 
-    size_t http_version_len = http_version_end - http_version_start;
-    parsed_http_request->http_version = (char *)malloc(http_version_len * (sizeof parsed_http_request->http_version) + 1);
-    if (parsed_http_request->http_version == NULL) {
-        fprintf(stderr, "Failed to allocate memory for parsed_http_request->http_version\nError code: %d\n", errno);
-        web_utils_http_request_free(parsed_http_request);
+    /**
+     * Every header of every request goes through here, and most of them are not indexed. A hash of
+     * the length and the first and last characters (case folded) picks the only indexed header the
+     * name can be, so there is at most one comparison and no chain of branches to mispredict.
+     */
+    unsigned int hash = (name.length + (name.start[0] | 0x20) + (name.start[name.length - 1] | 0x20)) & 31;
+    int candidate = web_utils_known_header_slots[hash];
+
+    if (candidate == -1 || web_utils_known_header_lengths[candidate] != name.length) {
         return -1;
     }
 
-    if (memcpy(parsed_http_request->http_version, http_version_start, http_version_len) == NULL) {
-        fprintf(stderr, "Failed to copy http version from http request into structure\nError code: %d\n", errno);
-        web_utils_http_request_free(parsed_http_request);
+    /** Browsers send these names capitalized exactly like web_utils_known_header_names */
+    if (memcmp(name.start, web_utils_known_header_names[candidate], name.length) != 0 &&
+        !web_utils_ascii_case_equals(name.start, web_utils_known_header_names[candidate], name.length)) {
         return -1;
     }
 
-    parsed_http_request->http_version[http_version_len] = '\0';
+    return candidate;
+}
 
-    /** 5. Extract http request headers */
-    char *headers_start = http_version_end + 2; /* Skip "\r\n" */
-    char *headers_end;
-    if ((headers_end = strstr(headers_start, "\r\n\r\n")) == NULL) {
-        fprintf(stderr, "Failed to find string\nError code: %d\n", errno);
-        web_utils_http_request_free(parsed_http_request);
-        return -1;
+/**
+ * Compares two runs of ASCII characters ignoring case. Header names are plain ASCII, and unlike
+ * strncasecmp this doesn't go through the locale, which showed up when classifying every header of
+ * a request: several common headers share their length with an indexed one (Sec-Fetch-Mode and
+ * Content-Length, Connection and HX-Request...).
+ *
+ * @return      1 if they are equal, 0 otherwise.
+ */
+unsigned int web_utils_ascii_case_equals(const char *a, const char *b, size_t length) {
+    size_t i;
+    for (i = 0; i < length; i++) {
+        char a_lower = a[i] >= 'A' && a[i] <= 'Z' ? a[i] + ('a' - 'A') : a[i];
+        char b_lower = b[i] >= 'A' && b[i] <= 'Z' ? b[i] + ('a' - 'A') : b[i];
+
+        if (a_lower != b_lower) {
+            return 0;
+        }
     }
 
-    size_t headers_len = headers_end - headers_start;
-    parsed_http_request->headers = (char *)malloc(headers_len * (sizeof parsed_http_request->headers) + 1);
-    if (parsed_http_request->headers == NULL) {
-        fprintf(stderr, "Failed to allocate memory for parsed_http_request->headers\nError code: %d\n", errno);
-        web_utils_http_request_free(parsed_http_request);
-        return -1;
+    return 1;
+}
+
+/**
+ * Finds the value of a header by name, without case sensitivity. Prefer web_utils_known_header
+ * for the headers that are indexed while parsing.
+ *
+ * @return      The value of the first header with that name, NULL if the request doesn't have it.
+ */
+const StringView *web_utils_find_header(const HttpRequest *request, const char *name) {
+    size_t name_length = strlen(name);
+
+    unsigned short i;
+    for (i = 0; i < request->headers_count; i++) {
+        const HttpHeader *header = &request->header_table[i];
+        if (header->name.length == name_length && web_utils_ascii_case_equals(header->name.start, name, name_length)) {
+            return &header->value;
+        }
     }
 
-    if (memcpy(parsed_http_request->headers, headers_start, headers_len) == NULL) {
-        fprintf(stderr, "Failed to copy headers from http request into structure\nError code: %d\n", errno);
-        web_utils_http_request_free(parsed_http_request);
-        return -1;
+    return NULL;
+}
+
+/**
+ * @param       known_header One of HTTP_HEADER_*.
+ * @return      The value of the header, NULL if the request doesn't have it.
+ */
+const StringView *web_utils_known_header(const HttpRequest *request, unsigned short known_header) {
+    short index = request->known_headers[known_header];
+    if (index == -1) {
+        return NULL;
     }
 
-    parsed_http_request->headers[headers_len] = '\0';
+    return &request->header_table[index].value;
+}
 
-    /** 6. Extract http request body */
-    char *body_start = headers_end + 4; /* Skip "\r\n\r\n" */
-    char *body_end;
-    if ((body_end = strchr(body_start, '\0')) == NULL) {
-        fprintf(stderr, "Failed to find char\nError code: %d\n", errno);
-        web_utils_http_request_free(parsed_http_request);
-        return -1;
+/**
+ * @return      1 if htmx sent the request (HX-Request: true), it only wants the partial it swaps in.
+ *              0 for a regular page load.
+ */
+unsigned int web_utils_hx_request(const HttpRequest *request) {
+    const StringView *hx_request = web_utils_known_header(request, HTTP_HEADER_HX_REQUEST);
+
+    return hx_request != NULL && web_utils_string_view_equals(*hx_request, "true");
+}
+
+/**
+ * @return      1 if the view holds exactly the characters of string, 0 otherwise.
+ */
+unsigned int web_utils_string_view_equals(StringView view, const char *string) {
+    size_t string_length = strlen(string);
+
+    return view.length == string_length && memcmp(view.start, string, string_length) == 0;
+}
+
+/**
+ * Whether the client takes responses in coding, going by its Accept-Encoding header. Codings listed
+ * with q=0 are refused, and "*" stands for every coding that isn't listed.
+ *
+ * @param       coding Lowercase, "gzip" or "deflate" for instance.
+ * @return      1 if the coding is acceptable, 0 otherwise.
+ */
+unsigned int web_utils_accepts_encoding(const HttpRequest *request, const char *coding) {
+    const StringView *accept_encoding = web_utils_known_header(request, HTTP_HEADER_ACCEPT_ENCODING);
+    if (accept_encoding == NULL) {
+        return 0;
     }
 
-    size_t body_length = body_end - body_start;
-    if (body_length > 0) {
-        parsed_http_request->body = (char *)malloc(body_length * (sizeof parsed_http_request->body) + 1);
-        if (parsed_http_request->body == NULL) {
-            fprintf(stderr, "Failed to allocate memory for parsed_http_request->body\nError code: %d\n", errno);
-            web_utils_http_request_free(parsed_http_request);
-            return -1;
+    size_t coding_length = strlen(coding);
+    unsigned int wildcard_accepted = 0;
+
+    const char *position = accept_encoding->start;
+    const char *end = accept_encoding->start + accept_encoding->length;
+    while (position < end) {
+        const char *item_end = memchr(position, ',', end - position);
+        if (item_end == NULL) {
+            item_end = end;
         }
 
-        if (memcpy(parsed_http_request->body, body_start, body_length) == NULL) {
-            fprintf(stderr, "Failed to copy request body from http request into structure\nError code: %d\n", errno);
-            web_utils_http_request_free(parsed_http_request);
-            return -1;
+        while (position < item_end && (*position == ' ' || *position == '\t')) {
+            position++;
         }
 
-        parsed_http_request->body[body_length] = '\0';
+        const char *token_end = position;
+        while (token_end < item_end && *token_end != ';' && *token_end != ' ' && *token_end != '\t') {
+            token_end++;
+        }
+
+        unsigned int accepted = !web_utils_zero_quality(token_end, item_end);
+        size_t token_length = token_end - position;
+
+        if (token_length == coding_length && web_utils_ascii_case_equals(position, coding, coding_length)) {
+            return accepted;
+        }
+
+        if (token_length == 1 && *position == '*') {
+            wildcard_accepted = accepted;
+        }
+
+        position = item_end + 1;
     }
 
-    return 0;
+    return wildcard_accepted;
 }
 
-void web_utils_http_request_free(HttpRequest *parsed_http_request) {
-    free(parsed_http_request->method);
-    parsed_http_request->method = NULL;
+/**
+ * @param       parameters What follows a coding in Accept-Encoding, up to the next ',': ";q=0.5".
+ * @return      1 if the parameters hold a quality of 0 ("q=0", "q=0.0", ...), 0 otherwise.
+ */
+unsigned int web_utils_zero_quality(const char *parameters, const char *end) {
+    const char *position = parameters;
+
+    while ((position = memchr(position, ';', end - position)) != NULL) {
+        position++;
+        while (position < end && (*position == ' ' || *position == '\t')) {
+            position++;
+        }
 
-    free(parsed_http_request->url);
-    parsed_http_request->url = NULL;
+        if (end - position < 3 || (position[0] != 'q' && position[0] != 'Q') || position[1] != '=') {
+            continue;
+        }
 
-    free(parsed_http_request->query_params);
-    parsed_http_request->query_params = NULL;
+        position += 2;
+        if (*position != '0') {
+            return 0;
+        }
 
-    free(parsed_http_request->body);
-    parsed_http_request->body = NULL;
+        position++;
+        if (position < end && *position == '.') {
+            position++;
+            while (position < end && *position == '0') {
+                position++;
+            }
+        }
 
-    free(parsed_http_request->http_version);
-    parsed_http_request->http_version = NULL;
+        return position == end || *position == ' ' || *position == '\t' || *position == ';';
+    }
 
-    free(parsed_http_request->headers);
-    parsed_http_request->headers = NULL;
+    return 0;
 }
 
-int web_utils_parse_value(char **buffer, const char key_name[], char *string) {
+int web_utils_parse_value(char **buffer, const char key_name[], const char *string) {
     /** To avoid modifying the original string pointer, create a new one that can be freely modified */
-    char *key = string;
+    const char *key = string;
 
     while (*key != '\0') {
-        char *key_end = strchr(key, '=');
+        const char *key_end = strchr(key, '=');
+        if (key_end == NULL) {
+            break;
+        }
+
         size_t key_length = key_end - key;
 
-        char *value_start = key_end + 1;
-        char *value_end = strchr(value_start, '&');
+        const char *value_start = key_end + 1;
+        const char *value_end = strchr(value_start, '&');
         if (value_end == NULL) {
             value_end = strchr(value_start, '\0');
         }
@@ -328,3 +457,114 @@ int web_utils_url_decode(char **string) {
 
     return 0;
 }
+
+/**
+ * Sends length bytes of a file starting at offset, see server_connection_write_file. The file offset
+ * isn't used nor moved, several ranges of the same file can be sent in any order.
+ */
+int web_utils_send_file_range(int client_socket, int file_fd, off_t offset, size_t length) {
+    Connection *conn = server_connection_get(client_socket);
+    if (conn == NULL || conn->fd == -1) {
+        fprintf(stderr, "No connection for client socket fd %d\nError code: %d\n", client_socket, errno);
+        return -1;
+    }
+
+    return server_connection_write_file(conn, file_fd, offset, length);
+}
+
+/**
+ * Parses a date in the format HTTP dates are sent in: "Sun, 06 Nov 1994 08:49:37 GMT". The obsolete
+ * formats the spec still allows are not understood.
+ *
+ * @return      0 on success, -1 if date isn't in that format.
+ */
+int web_utils_parse_http_date(StringView date, time_t *time) {
+    if (date.length >= 64) {
+        return -1;
+    }
+
+    char date_string[64];
+    memcpy(date_string, date.start, date.length);
+    date_string[date.length] = '\0';
+
+    struct tm date_tm;
+    memset(&date_tm, 0, sizeof date_tm);
+
+    const char *date_end = strptime(date_string, "%a, %d %b %Y %H:%M:%S GMT", &date_tm);
+    if (date_end == NULL || *date_end != '\0') {
+        return -1;
+    }
+
+    *time = timegm(&date_tm);
+
+    return 0;
+}
+
+/**
+ * Weak comparison of an entity tag against the list of an If-None-Match header: "W/" prefixes are
+ * ignored on both sides, and "*" matches any tag.
+ *
+ * @param       etag Quoted, with or without the "W/" prefix.
+ * @return      1 if the list holds the tag, 0 otherwise.
+ */
+unsigned int web_utils_etag_matches(StringView if_none_match, const char *etag, size_t etag_length) {
+    if (etag_length >= 2 && etag[0] == 'W' && etag[1] == '/') {
+        etag += 2;
+        etag_length -= 2;
+    }
+
+    const char *position = if_none_match.start;
+    const char *end = if_none_match.start + if_none_match.length;
+    while (position < end) {
+        while (position < end && (*position == ' ' || *position == '\t' || *position == ',')) {
+            position++;
+        }
+
+        if (position == end) {
+            break;
+        }
+
+        const char *item_end = memchr(position, ',', end - position);
+        if (item_end == NULL) {
+            item_end = end;
+        }
+
+        const char *tag_end = item_end;
+        while (tag_end > position && (tag_end[-1] == ' ' || tag_end[-1] == '\t')) {
+            tag_end--;
+        }
+
+        if (tag_end - position == 1 && *position == '*') {
+            return 1;
+        }
+
+        if (tag_end - position >= 2 && position[0] == 'W' && position[1] == '/') {
+            position += 2;
+        }
+
+        if ((size_t)(tag_end - position) == etag_length && memcmp(position, etag, etag_length) == 0) {
+            return 1;
+        }
+
+        position = item_end;
+    }
+
+    return 0;
+}
+
+/**
+ * Gathered send that never blocks the worker: what the socket buffer can't take right away is left
+ * to the event loop to send once the client reads, see server_connection_write.
+ *
+ * @param       iov Modified, entries that were sent are consumed.
+ * @param       flags Passed on to sendmsg.
+ */
+int web_utils_send_all(int client_socket, struct iovec *iov, int iovcnt, int flags) {
+    Connection *conn = server_connection_get(client_socket);
+    if (conn == NULL || conn->fd == -1) {
+        fprintf(stderr, "No connection for client socket fd %d\nError code: %d\n", client_socket, errno);
+        return -1;
+    }
+
+    return server_connection_write(conn, iov, iovcnt, flags);
+}